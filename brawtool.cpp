@@ -3,8 +3,25 @@
 // Copyright (c) 2022 - present Mikael Sundell.
 //
 
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <condition_variable>
+#include <cstring>
 #include <fstream>
+#include <functional>
+#include <future>
 #include <iostream>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <numeric>
+#include <set>
+#include <thread>
+#include <tuple>
 #include <variant>
 #include <vector>
 
@@ -12,7 +29,9 @@
 #include <OpenImageIO/argparse.h>
 #include <OpenImageIO/filesystem.h>
 #include <OpenImageIO/imageio.h>
+#include <OpenImageIO/parallel.h>
 #include <OpenImageIO/sysutil.h>
+#include <OpenImageIO/timer.h>
 #include <OpenImageIO/typedesc.h>
 
 #include <OpenImageIO/imagebuf.h>
@@ -25,7 +44,24 @@ using namespace OIIO;
 using namespace OpenColorIO_v2_3;
 
 // braw
-#include <BlackmagicRawAPI.h>
+#if defined(BlackmagicRaw_FOUND)
+#    include <BlackmagicRawAPI.h>
+#endif
+
+// simd
+#if defined(__x86_64__) || defined(_M_X64)
+#    include <immintrin.h>
+#endif
+
+// posix
+#include <sys/stat.h>
+#include <sys/xattr.h>
+#include <unistd.h>
+#if defined(__linux__)
+#    include <poll.h>
+#    include <sys/inotify.h>
+#    include <sys/mman.h>
+#endif
 
 // boost
 #include <boost/algorithm/hex.hpp>
@@ -77,6 +113,310 @@ print_error(std::string param)
     print_error<std::string>(param);
 }
 
+// braw metrics
+class BrawMetrics {
+public:
+    BrawMetrics()
+    {
+        const std::vector<double> buckets = { 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30 };
+        m_families = {
+            { "brawtool_clips_processed_total", "counter", "Clips processed", {} },
+            { "brawtool_frames_processed_total", "counter", "Frames decoded", {} },
+            { "brawtool_frame_cache_hits_total", "counter", "Frames read from the frame cache", {} },
+            { "brawtool_frame_cache_misses_total", "counter", "Frames decoded and written to the frame cache", {} },
+            { "brawtool_buffer_pool_hits_total", "counter", "Frame buffers reused from the buffer pool", {} },
+            { "brawtool_buffer_pool_misses_total", "counter", "Frame buffers allocated by the buffer pool", {} },
+            { "brawtool_buffer_pool_allocated_bytes_total", "counter", "Bytes allocated by the buffer pool", {} },
+            { "brawtool_decode_seconds", "histogram", "Frame decode time in seconds", buckets },
+            { "brawtool_postprocess_seconds", "histogram", "Resize, 3dlut, metadata and write time in seconds",
+              buckets },
+            { "brawtool_cloned_bytes_total", "counter", "Bytes cloned to output directories", {} },
+            { "brawtool_hashed_bytes_total", "counter", "Bytes hashed for clone verification", {} },
+            { "brawtool_hash_seconds_total", "counter", "Time spent hashing in seconds", {} },
+            { "brawtool_hash_megabytes_per_second", "gauge", "Throughput of the last hash", {} },
+            { "brawtool_failures_total", "counter", "Failures by stage", {} },
+            { "brawtool_last_update_timestamp_seconds", "gauge", "Time of the last metrics update", {} },
+        };
+    }
+
+    void count(const std::string& name, double value = 1.0)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_samples[name] += value;
+    }
+
+    void set(const std::string& name, double value)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_samples[name] = value;
+    }
+
+    void observe(const std::string& name, double value)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const Family& family : m_families) {
+            if (family.name != name) {
+                continue;
+            }
+            for (double bucket : family.buckets) {
+                if (value <= bucket) {
+                    m_samples[name + "_bucket{le=\"" + bucket_str(bucket) + "\"}"] += 1;
+                }
+            }
+            m_samples[name + "_bucket{le=\"+Inf\"}"] += 1;
+            m_samples[name + "_sum"] += value;
+            m_samples[name + "_count"] += 1;
+        }
+    }
+
+    void failure(const std::string& stage) { count("brawtool_failures_total{stage=\"" + stage + "\"}"); }
+
+    bool read(const std::string& filename)
+    {
+        // counters are resumed so successive runs accumulate in the same text file
+        std::ifstream file(filename);
+        if (!file.is_open()) {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::string line;
+        while (getline(file, line)) {
+            size_t pos = line.rfind(' ');
+            if (line.empty() || line[0] == '#' || pos == std::string::npos) {
+                continue;
+            }
+            m_samples[line.substr(0, pos)] = Strutil::stod(line.substr(pos + 1));  // counters exceed float precision
+        }
+        return true;
+    }
+
+    bool write(const std::string& filename)
+    {
+        set("brawtool_last_update_timestamp_seconds", static_cast<double>(time(nullptr)));
+        std::string tempfilename = filename + "." + std::to_string(getpid()) + ".tmp";
+        std::string error;
+        {
+            std::ofstream file(tempfilename);
+            if (!file) {
+                return false;
+            }
+            file.precision(15);
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (const Family& family : m_families) {
+                file << "# HELP " << family.name << " " << family.help << "\n";
+                file << "# TYPE " << family.name << " " << family.type << "\n";
+                if (family.type == "histogram") {
+                    for (double bucket : family.buckets) {
+                        write_sample(file, family.name + "_bucket{le=\"" + bucket_str(bucket) + "\"}");
+                    }
+                    write_sample(file, family.name + "_bucket{le=\"+Inf\"}");
+                    write_sample(file, family.name + "_sum");
+                    write_sample(file, family.name + "_count");
+                }
+                else {
+                    bool labels = false;
+                    for (const std::pair<const std::string, double>& sample : m_samples) {
+                        if (Strutil::starts_with(sample.first, family.name + "{")) {
+                            write_sample(file, sample.first);
+                            labels = true;
+                        }
+                    }
+                    if (!labels) {
+                        write_sample(file, family.name);
+                    }
+                }
+            }
+            file.flush();
+            if (!file) {
+                file.close();
+                Filesystem::remove(tempfilename, error);  // a short write never replaces the previous file
+                return false;
+            }
+        }
+        return Filesystem::rename(tempfilename, filename, error);  // scrapers never see a partial file
+    }
+
+    void start(const std::string& filename, int interval)
+    {
+        m_filename = filename;
+        read(m_filename);
+        m_running = true;
+        m_thread = std::thread([this, interval]() {
+            std::unique_lock<std::mutex> lock(m_threadmutex);
+            while (m_running) {
+                m_condition.wait_for(lock, std::chrono::seconds(interval));
+                write(m_filename);
+            }
+        });
+    }
+
+    void stop()
+    {
+        if (!m_thread.joinable()) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_threadmutex);
+            m_running = false;
+        }
+        m_condition.notify_all();
+        m_thread.join();
+        write(m_filename);
+    }
+
+private:
+    struct Family {
+        std::string name;
+        std::string type;
+        std::string help;
+        std::vector<double> buckets;
+    };
+
+    void write_sample(std::ofstream& file, const std::string& name)
+    {
+        file << name << " " << (m_samples.count(name) ? m_samples[name] : 0.0) << "\n";
+    }
+
+    static std::string bucket_str(double bucket)
+    {
+        std::ostringstream stream;
+        stream << bucket;
+        return stream.str();
+    }
+
+    std::vector<Family> m_families;
+    std::map<std::string, double> m_samples;
+    std::mutex m_mutex;
+    std::string m_filename;
+    std::thread m_thread;
+    std::mutex m_threadmutex;
+    std::condition_variable m_condition;
+    bool m_running = false;
+};
+
+static BrawMetrics metrics;
+
+// braw buffer pool
+class BrawBufferPool {
+public:
+    ~BrawBufferPool()
+    {
+        for (const std::pair<const size_t, float*>& buffer : m_free) {
+            free(buffer.second);
+        }
+    }
+
+    std::shared_ptr<float> acquire(size_t count)
+    {
+        // buffers are matched by size, frames of a clip and of clips from the same camera reuse each other
+        size_t bytes = count * sizeof(float);
+        float* data = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto it = m_free.find(bytes);
+            if (it != m_free.end()) {
+                data = it->second;
+                m_free.erase(it);
+                m_idlebytes -= bytes;
+                m_hits++;
+            }
+            else {
+                m_misses++;
+                m_allocatedbytes += bytes;
+            }
+        }
+        if (data != nullptr) {
+            metrics.count("brawtool_buffer_pool_hits_total");
+        }
+        else {
+            data = allocate(bytes);
+            metrics.count("brawtool_buffer_pool_misses_total");
+            metrics.count("brawtool_buffer_pool_allocated_bytes_total", static_cast<double>(bytes));
+        }
+        return std::shared_ptr<float>(data, [this, bytes](float* data) { release(data, bytes); });
+    }
+
+    void set_limit(size_t bytes) { m_limit = bytes; }
+    void set_hugepages(bool hugepages) { m_hugepages = hugepages; }
+
+    std::string str()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return std::to_string(m_hits) + " hits, " + std::to_string(m_misses) + " misses, "
+               + std::to_string(m_allocatedbytes / (1024 * 1024)) + " MB allocated";
+    }
+
+private:
+    float* allocate(size_t bytes)
+    {
+        // cache line aligned rows, or huge page aligned so that the kernel can back frames with huge pages
+        const size_t hugepagesize = 2 * 1024 * 1024;
+        void* data = nullptr;
+        if (posix_memalign(&data, m_hugepages ? hugepagesize : 64, bytes) != 0) {
+            throw std::bad_alloc();
+        }
+#if defined(__linux__)
+        if (m_hugepages) {
+            madvise(data, bytes, MADV_HUGEPAGE);
+        }
+#endif
+        return static_cast<float*>(data);
+    }
+
+    void release(float* data, size_t bytes)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_idlebytes + bytes > m_limit) {
+            free(data);
+            return;
+        }
+        m_free.insert(std::make_pair(bytes, data));
+        m_idlebytes += bytes;
+    }
+
+    std::multimap<size_t, float*> m_free;
+    size_t m_idlebytes = 0;
+    size_t m_limit = 4096ull * 1024 * 1024;
+    bool m_hugepages = false;
+    uint64_t m_hits = 0;
+    uint64_t m_misses = 0;
+    uint64_t m_allocatedbytes = 0;
+    std::mutex m_mutex;
+};
+
+static BrawBufferPool bufferpool;
+
+ImageBuf
+pooled_image(const ImageSpec& spec, std::vector<std::shared_ptr<float>>& leases)
+{
+    // copies of the image share the pooled pixels, the leases must outlive every copy
+    leases.push_back(bufferpool.acquire(spec.image_pixels() * spec.nchannels));
+    return ImageBuf(spec, leases.back().get());
+}
+
+// braw variant
+struct BrawVariant {
+    std::string name;
+    boost::optional<int> width;
+    boost::optional<int> height;
+    std::string lut;  // none, sidecar or colorspace name
+    bool applymetadata = false;
+    std::string outputformat;
+    std::string outputdatatype;
+    boost::optional<int> kelvin;  // wedge decode adjustments drawn by metadata, tool values otherwise
+    boost::optional<int> tint;
+    boost::optional<float> exposure;
+};
+
+// braw wedge
+struct BrawWedge {
+    std::string name;   // used in filenames, exposure-2_kelvin3200
+    std::string label;  // drawn on grid cells, exposure: -2, kelvin: 3200
+    boost::optional<int> kelvin;
+    boost::optional<int> tint;
+    boost::optional<float> exposure;
+};
+
 // braw tool
 struct BrawTool {
     bool help = false;
@@ -90,10 +430,47 @@ struct BrawTool {
     boost::optional<int> tint;
     boost::optional<int> width;
     boost::optional<int> height;
-    std::string inputfilename;
+    boost::optional<ROI> crop;
+    std::vector<std::string> inputfilenames;
     std::string outputdirectory;
     std::string outputformat = "png";
+    std::string outputdatatype;
+    std::string compression;
+    int tilesize = 0;
+    int threads = 0;
+    bool benchmark = false;
+    int trimstart = -1;
+    int trimend = -1;
+    bool stats = false;
+    bool extractaudio = false;
+    bool thumbnail = false;
+    bool proxypreview = false;
+    std::string stream;
+    std::string streamformat = "y4m";
+    int streambuffer = 4;
+    int framestart = -1;
+    int frameend = -1;
+    int pyramid = 0;
+    std::string pyramidfilter = "box";
+    std::string resizefilter = "triangle";
     std::string override3dlut;
+    std::string hashcache;
+    std::string metricsfile;
+    int metricsinterval = 10;
+    std::string cachedirectory;
+    int cachesize = 10240;
+    int bufferpool = 4096;
+    bool hugepages = false;
+    int syntheticwidth = 0;
+    int syntheticheight = 0;
+    int syntheticframes = 24;
+    std::string lutengine = "auto";
+    std::vector<BrawVariant> variants;
+    std::vector<BrawWedge> wedges;
+    bool wedgegrid = false;
+    std::vector<std::string> watchdirectories;
+    int watchinterval = 5;
+    std::string watchjournal;
     int code = EXIT_SUCCESS;
 };
 
@@ -103,7 +480,40 @@ static int
 set_inputfilename(int argc, const char* argv[])
 {
     OIIO_DASSERT(argc == 2);
-    tool.inputfilename = argv[1];
+    tool.inputfilenames.push_back(argv[1]);
+    return 0;
+}
+
+static int
+set_inputfilenames(int argc, const char* argv[])
+{
+    for (int i = 0; i < argc; i++) {
+        tool.inputfilenames.push_back(argv[i]);
+    }
+    return 0;
+}
+
+static int
+set_watch(int argc, const char* argv[])
+{
+    OIIO_DASSERT(argc == 2);
+    tool.watchdirectories.push_back(argv[1]);
+    return 0;
+}
+
+static int
+set_watchinterval(int argc, const char* argv[])
+{
+    OIIO_DASSERT(argc == 2);
+    tool.watchinterval = std::max(1, Strutil::stoi(argv[1]));
+    return 0;
+}
+
+static int
+set_watchjournal(int argc, const char* argv[])
+{
+    OIIO_DASSERT(argc == 2);
+    tool.watchjournal = argv[1];
     return 0;
 }
 
@@ -147,6 +557,27 @@ set_height(int argc, const char* argv[])
     return 0;
 }
 
+static int
+set_crop(int argc, const char* argv[])
+{
+    OIIO_DASSERT(argc == 2);
+    std::vector<std::string> values = Strutil::splits(argv[1], ",");
+    if (values.size() != 4) {
+        print_error("could not parse crop: ", argv[1]);
+        return -1;
+    }
+    int x = Strutil::stoi(values[0]);
+    int y = Strutil::stoi(values[1]);
+    int width = Strutil::stoi(values[2]);
+    int height = Strutil::stoi(values[3]);
+    if (x < 0 || y < 0 || width <= 0 || height <= 0) {
+        print_error("crop must have a positive size and origin: ", argv[1]);
+        return -1;
+    }
+    tool.crop = ROI(x, x + width, y, y + height);
+    return 0;
+}
+
 static int
 set_override3dlut(int argc, const char* argv[])
 {
@@ -171,121 +602,549 @@ set_outputformat(int argc, const char* argv[])
     return 0;
 }
 
-static void
-print_help(ArgParse& ap)
+static int
+set_outputdatatype(int argc, const char* argv[])
 {
-    ap.print_help();
+    OIIO_DASSERT(argc == 2);
+    tool.outputdatatype = argv[1];
+    return 0;
 }
 
-// utils - dates
-std::string
-datetime()
+static int
+set_compression(int argc, const char* argv[])
 {
-    std::time_t now = time(NULL);
-    struct tm tm;
-    Sysutil::get_local_time(&now, &tm);
-    char datetime[20];
-    strftime(datetime, 20, "%Y-%m-%d %H:%M:%S", &tm);
-    return std::string(datetime);
+    OIIO_DASSERT(argc == 2);
+    tool.compression = argv[1];
+    return 0;
 }
 
-std::string
-str_by_float(float value)
+static int
+set_tilesize(int argc, const char* argv[])
 {
-    std::stringstream stream;
-    stream << std::fixed << std::setprecision(1) << value;
-    return stream.str();
+    OIIO_DASSERT(argc == 2);
+    tool.tilesize = Strutil::stoi(argv[1]);
+    return 0;
 }
 
-std::string
-str_by_int(int value)
+static int
+set_threads(int argc, const char* argv[])
 {
-    return std::to_string(value);
+    OIIO_DASSERT(argc == 2);
+    tool.threads = Strutil::stoi(argv[1]);
+    return 0;
 }
 
-// utils - core foundation
-CFStringRef
-cfstr_by_str(const std::string& str)
+static int
+set_hashcache(int argc, const char* argv[])
 {
-    CFStringRef ref = CFStringCreateWithBytes(kCFAllocatorDefault, reinterpret_cast<const UInt8*>(str.c_str()),
-                                              str.length(), kCFStringEncodingUTF8, false);
-    return ref;
+    OIIO_DASSERT(argc == 2);
+    tool.hashcache = argv[1];
+    return 0;
 }
 
-// utils - filesystem
-std::string
-filename(const std::string& path)
+static int
+set_metricsfile(int argc, const char* argv[])
 {
-    return Filesystem::filename(path);
+    OIIO_DASSERT(argc == 2);
+    tool.metricsfile = argv[1];
+    return 0;
 }
 
-std::string
-extension(const std::string& path, const std::string& extension)
+static int
+set_metricsinterval(int argc, const char* argv[])
 {
-    return Filesystem::replace_extension(path, extension);
+    OIIO_DASSERT(argc == 2);
+    tool.metricsinterval = std::max(1, Strutil::stoi(argv[1]));
+    return 0;
 }
 
-bool
-exists(const std::string& path)
+static int
+set_cachedirectory(int argc, const char* argv[])
 {
-    return Filesystem::exists(path);
+    OIIO_DASSERT(argc == 2);
+    tool.cachedirectory = argv[1];
+    return 0;
 }
 
-std::string
-hash_file(const std::string& path)
+static int
+set_cachesize(int argc, const char* argv[])
 {
-    boost::filesystem::path filepath(path);
-    std::ifstream file(filepath.string(), std::ios::binary);
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    boost::uuids::detail::md5 hash;
-    boost::uuids::detail::md5::digest_type digest;
-    hash.process_bytes(buffer.str().data(), buffer.str().size());
-    hash.get_digest(digest);
-    const char* chardigest = reinterpret_cast<const char*>(&digest);
-    std::string result;
-    boost::algorithm::hex(chardigest, chardigest + sizeof(boost::uuids::detail::md5::digest_type),
-                          std::back_inserter(result));
-    return result;
+    OIIO_DASSERT(argc == 2);
+    tool.cachesize = std::max(0, Strutil::stoi(argv[1]));
+    return 0;
 }
 
-bool
-copy_file(const std::string& input, const boost::filesystem::path& output)
+static int
+set_bufferpool(int argc, const char* argv[])
 {
-    boost::filesystem::path inputpath(input);
-    boost::filesystem::path outputpath(output);
-    try {
-        if (!boost::filesystem::exists(outputpath.parent_path())) {
-            boost::filesystem::create_directories(outputpath.parent_path());
-        }
-        boost::filesystem::copy_file(inputpath, outputpath, boost::filesystem::copy_options::overwrite_existing);
-        return true;
-    } catch (const boost::filesystem::filesystem_error& e) {
-        return false;
-    }
+    OIIO_DASSERT(argc == 2);
+    tool.bufferpool = std::max(0, Strutil::stoi(argv[1]));
+    return 0;
 }
 
-bool
-file_compare(const std::string& source, const std::string& target)
+static int
+set_trim(int argc, const char* argv[])
 {
-    return hash_file(source) == hash_file(target);
+    OIIO_DASSERT(argc == 2);
+    std::vector<std::string> range = Strutil::splits(argv[1], "-");
+    if (range.size() != 2) {
+        print_error("could not parse trim range: ", argv[1]);
+        return -1;
+    }
+    tool.trimstart = Strutil::stoi(range[0]);
+    tool.trimend = Strutil::stoi(range[1]);
+    return 0;
 }
 
-bool
-create_path(const std::string& path)
+static int
+set_stream(int argc, const char* argv[])
 {
-    std::string error;
-    return Filesystem::create_directory(path, error);
+    OIIO_DASSERT(argc == 2);
+    tool.stream = argv[1];
+    return 0;
 }
 
-std::string
-filename_path(const std::string& path)
+static int
+set_streamformat(int argc, const char* argv[])
 {
-    return Filesystem::parent_path(path);
+    OIIO_DASSERT(argc == 2);
+    tool.streamformat = argv[1];
+    return 0;
 }
 
-std::string
-program_path(const std::string& path)
+static int
+set_streambuffer(int argc, const char* argv[])
+{
+    OIIO_DASSERT(argc == 2);
+    tool.streambuffer = Strutil::stoi(argv[1]);
+    return 0;
+}
+
+static int
+set_frames(int argc, const char* argv[])
+{
+    OIIO_DASSERT(argc == 2);
+    std::vector<std::string> range = Strutil::splits(argv[1], "-");
+    if (range.size() != 2) {
+        print_error("could not parse frame range: ", argv[1]);
+        return -1;
+    }
+    tool.framestart = Strutil::stoi(range[0]);
+    tool.frameend = Strutil::stoi(range[1]);
+    return 0;
+}
+
+static int
+set_lutengine(int argc, const char* argv[])
+{
+    OIIO_DASSERT(argc == 2);
+    tool.lutengine = argv[1];
+    return 0;
+}
+
+static int
+set_pyramid(int argc, const char* argv[])
+{
+    OIIO_DASSERT(argc == 2);
+    tool.pyramid = Strutil::stoi(argv[1]);
+    return 0;
+}
+
+static int
+set_pyramidfilter(int argc, const char* argv[])
+{
+    OIIO_DASSERT(argc == 2);
+    tool.pyramidfilter = argv[1];
+    return 0;
+}
+
+static int
+set_resizefilter(int argc, const char* argv[])
+{
+    OIIO_DASSERT(argc == 2);
+    tool.resizefilter = argv[1];
+    return 0;
+}
+
+static int
+set_synthetic(int argc, const char* argv[])
+{
+    OIIO_DASSERT(argc == 2);
+    std::vector<std::string> size = Strutil::splits(argv[1], "x");
+    if (size.size() != 2 || Strutil::stoi(size[0]) <= 0 || Strutil::stoi(size[1]) <= 0) {
+        print_error("could not parse synthetic size: ", argv[1]);
+        return -1;
+    }
+    tool.syntheticwidth = Strutil::stoi(size[0]);
+    tool.syntheticheight = Strutil::stoi(size[1]);
+    return 0;
+}
+
+static int
+set_syntheticframes(int argc, const char* argv[])
+{
+    OIIO_DASSERT(argc == 2);
+    tool.syntheticframes = Strutil::stoi(argv[1]);
+    return 0;
+}
+
+static bool
+variant_by_str(const std::string& str, BrawVariant& variant)
+{
+    // name:key=value,key=value
+    size_t pos = str.find(':');
+    variant.name = str.substr(0, pos);
+    if (!variant.name.size() || variant.name.find_first_of("/\\") != std::string::npos) {
+        return false;  // names are used in output filenames
+    }
+    if (pos == std::string::npos) {
+        return true;
+    }
+    for (const std::string& pair : Strutil::splits(str.substr(pos + 1), ",")) {
+        std::vector<std::string> keyvalue = Strutil::splits(pair, "=", 2);
+        if (keyvalue.size() != 2) {
+            return false;
+        }
+        const std::string& key = keyvalue[0];
+        const std::string& value = keyvalue[1];
+        if ((key == "width" || key == "height") && (!Strutil::string_is_int(value) || Strutil::stoi(value) <= 0)) {
+            return false;  // 0 would silently mean unset
+        }
+        if (key == "width") {
+            variant.width = Strutil::stoi(value);
+        }
+        else if (key == "height") {
+            variant.height = Strutil::stoi(value);
+        }
+        else if (key == "lut") {
+            variant.lut = value == "none" ? "" : value;
+        }
+        else if (key == "metadata") {
+            variant.applymetadata = Strutil::stoi(value) != 0;
+        }
+        else if (key == "format") {
+            variant.outputformat = value;
+        }
+        else if (key == "datatype") {
+            variant.outputdatatype = value;
+        }
+        else {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int
+set_variant(int argc, const char* argv[])
+{
+    OIIO_DASSERT(argc == 2);
+    BrawVariant variant;
+    if (!variant_by_str(argv[1], variant)) {
+        print_error("could not parse variant: ", argv[1]);
+        return -1;
+    }
+    for (const BrawVariant& other : tool.variants) {
+        if (other.name == variant.name) {
+            print_error("duplicate variant name: ", variant.name);  // would write the same output file
+            return -1;
+        }
+    }
+    tool.variants.push_back(variant);
+    return 0;
+}
+
+static bool
+wedge_by_str(const std::string& str, std::vector<BrawWedge>& wedges)
+{
+    // key=value,value, every flag is combined with the wedges of previous flags
+    std::vector<std::string> keyvalue = Strutil::splits(str, "=", 2);
+    if (keyvalue.size() != 2) {
+        return false;
+    }
+    const std::string& key = keyvalue[0];
+    if (key != "kelvin" && key != "tint" && key != "exposure") {
+        return false;
+    }
+    std::vector<BrawWedge> combined;
+    std::vector<BrawWedge> previous = wedges.size() ? wedges : std::vector<BrawWedge>(1);
+    for (const BrawWedge& wedge : previous) {
+        for (const std::string& value : Strutil::splits(keyvalue[1], ",")) {
+            BrawWedge result = wedge;
+            if (key == "kelvin") {
+                result.kelvin = Strutil::stoi(value);
+            }
+            else if (key == "tint") {
+                result.tint = Strutil::stoi(value);
+            }
+            else {
+                result.exposure = Strutil::stof(value);
+            }
+            result.name += (result.name.size() ? "_" : "") + key + value;
+            result.label += (result.label.size() ? ", " : "") + key + ": " + value;
+            combined.push_back(result);
+        }
+    }
+    if (!combined.size()) {
+        return false;
+    }
+    wedges = combined;
+    return true;
+}
+
+static int
+set_wedge(int argc, const char* argv[])
+{
+    OIIO_DASSERT(argc == 2);
+    if (!wedge_by_str(argv[1], tool.wedges)) {
+        print_error("could not parse wedge: ", argv[1]);
+        return -1;
+    }
+    return 0;
+}
+
+static void
+print_help(ArgParse& ap)
+{
+    ap.print_help();
+}
+
+// utils - dates
+std::string
+datetime()
+{
+    std::time_t now = time(NULL);
+    struct tm tm;
+    Sysutil::get_local_time(&now, &tm);
+    char datetime[20];
+    strftime(datetime, 20, "%Y-%m-%d %H:%M:%S", &tm);
+    return std::string(datetime);
+}
+
+std::string
+str_by_float(float value)
+{
+    std::stringstream stream;
+    stream << std::fixed << std::setprecision(1) << value;
+    return stream.str();
+}
+
+std::string
+str_by_int(int value)
+{
+    return std::to_string(value);
+}
+
+#if defined(BlackmagicRaw_FOUND)
+// utils - core foundation
+CFStringRef
+cfstr_by_str(const std::string& str)
+{
+    CFStringRef ref = CFStringCreateWithBytes(kCFAllocatorDefault, reinterpret_cast<const UInt8*>(str.c_str()),
+                                              str.length(), kCFStringEncodingUTF8, false);
+    return ref;
+}
+
+struct BrawCFRelease {
+    void operator()(const void* ref) const { CFRelease(ref); }
+};
+using BrawCFRef = std::unique_ptr<const void, BrawCFRelease>;
+#endif
+
+// utils - filesystem
+std::string
+filename(const std::string& path)
+{
+    return Filesystem::filename(path);
+}
+
+std::string
+extension(const std::string& path, const std::string& extension)
+{
+    return Filesystem::replace_extension(path, extension);
+}
+
+bool
+exists(const std::string& path)
+{
+    return Filesystem::exists(path);
+}
+
+std::string
+hash_file(const std::string& path)
+{
+    boost::filesystem::path filepath(path);
+    std::ifstream file(filepath.string(), std::ios::binary);
+    boost::uuids::detail::md5 hash;
+    boost::uuids::detail::md5::digest_type digest;
+    std::vector<char> buffer(4 * 1024 * 1024);  // streamed in chunks, never the whole clip in memory
+    uint64_t bytes = 0;
+    Timer timer;
+    while (file.read(buffer.data(), buffer.size()) || file.gcount() > 0) {
+        hash.process_bytes(buffer.data(), file.gcount());
+        bytes += file.gcount();
+    }
+    hash.get_digest(digest);
+    double seconds = timer();
+    metrics.count("brawtool_hashed_bytes_total", static_cast<double>(bytes));
+    metrics.count("brawtool_hash_seconds_total", seconds);
+    if (seconds > 0.0) {
+        metrics.set("brawtool_hash_megabytes_per_second", bytes / (1024.0 * 1024.0) / seconds);
+    }
+    const char* chardigest = reinterpret_cast<const char*>(&digest);
+    std::string result;
+    boost::algorithm::hex(chardigest, chardigest + sizeof(boost::uuids::detail::md5::digest_type),
+                          std::back_inserter(result));
+    return result;
+}
+
+bool
+copy_file(const std::string& input, const boost::filesystem::path& output)
+{
+    boost::filesystem::path inputpath(input);
+    boost::filesystem::path outputpath(output);
+    try {
+        if (!boost::filesystem::exists(outputpath.parent_path())) {
+            boost::filesystem::create_directories(outputpath.parent_path());
+        }
+        boost::filesystem::copy_file(inputpath, outputpath, boost::filesystem::copy_options::overwrite_existing);
+        metrics.count("brawtool_cloned_bytes_total", static_cast<double>(boost::filesystem::file_size(outputpath)));
+        return true;
+    } catch (const boost::filesystem::filesystem_error& e) {
+        return false;
+    }
+}
+
+// utils - hash cache
+std::string
+hash_key(const std::string& path)
+{
+    // size, mtime and inode, any change to the file invalidates the cached digest
+    struct stat info;
+    if (::stat(path.c_str(), &info) != 0) {
+        return std::string();
+    }
+#if defined(__APPLE__)
+    int64_t mtime = static_cast<int64_t>(info.st_mtimespec.tv_sec) * 1000000000 + info.st_mtimespec.tv_nsec;
+#else
+    int64_t mtime = static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+#endif
+    return std::to_string(info.st_size) + ":" + std::to_string(mtime) + ":" + std::to_string(info.st_ino);
+}
+
+bool
+read_hash_xattr(const std::string& path, std::string& value)
+{
+    char buffer[256];
+#if defined(__APPLE__)
+    ssize_t size = ::getxattr(path.c_str(), "com.brawtool.md5", buffer, sizeof(buffer), 0, 0);
+#else
+    ssize_t size = ::getxattr(path.c_str(), "user.brawtool.md5", buffer, sizeof(buffer));
+#endif
+    if (size <= 0) {
+        return false;
+    }
+    value.assign(buffer, size);
+    return true;
+}
+
+bool
+write_hash_xattr(const std::string& path, const std::string& value)
+{
+#if defined(__APPLE__)
+    return ::setxattr(path.c_str(), "com.brawtool.md5", value.data(), value.size(), 0, 0) == 0;
+#else
+    return ::setxattr(path.c_str(), "user.brawtool.md5", value.data(), value.size(), 0) == 0;
+#endif
+}
+
+std::string
+hashcache_path()
+{
+    if (tool.hashcache.size()) {
+        return tool.hashcache;
+    }
+    std::string home = Sysutil::getenv("HOME");
+    return home.size() ? home + "/.brawtool_hashcache" : std::string();
+}
+
+std::string
+cached_hash_file(const std::string& path)
+{
+    // digests are cached in an extended attribute on the file, or in a sidecar cache file
+    // for read-only media and filesystems without xattr support.
+    static std::mutex mutex;
+    static std::map<std::string, std::string> hashcache;
+    static bool hashcacheread = false;
+
+    std::string key = hash_key(path);
+    if (!key.size()) {
+        return hash_file(path);
+    }
+    std::string value;
+    if (read_hash_xattr(path, value) && Strutil::starts_with(value, key + " ")) {
+        print_info("using cached hash from extended attribute for: ", path);
+        return value.substr(key.size() + 1);
+    }
+    std::string cachefile = hashcache_path();
+    std::string entry = boost::filesystem::absolute(path).string() + "\t" + key;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!hashcacheread && cachefile.size()) {
+            std::ifstream cache(cachefile);
+            std::string line;
+            while (getline(cache, line)) {
+                size_t pos = line.rfind('\t');
+                if (pos != std::string::npos) {
+                    hashcache[line.substr(0, pos)] = line.substr(pos + 1);  // later lines win
+                }
+            }
+            hashcacheread = true;
+        }
+        if (hashcache.count(entry)) {
+            print_info("using cached hash from cache file for: ", path);
+            return hashcache[entry];
+        }
+    }
+    std::string digest = hash_file(path);
+    if (!write_hash_xattr(path, key + " " + digest) && cachefile.size()) {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::ofstream cache(cachefile, std::ios::app);
+        if (cache) {
+            cache << entry << "\t" << digest << std::endl;
+        }
+        hashcache[entry] = digest;
+    }
+    return digest;
+}
+
+bool
+file_compare(const std::string& source, const std::string& target)
+{
+    // the source digest is reused across destinations, the target is always read back
+    std::string targetdigest = hash_file(target);
+    std::string key = hash_key(target);
+    if (key.size()) {
+        write_hash_xattr(target, key + " " + targetdigest);
+    }
+    return cached_hash_file(source) == targetdigest;
+}
+
+bool
+create_path(const std::string& path)
+{
+    std::string error;
+    return Filesystem::create_directory(path, error);
+}
+
+std::string
+filename_path(const std::string& path)
+{
+    return Filesystem::parent_path(path);
+}
+
+std::string
+program_path(const std::string& path)
 {
     return Filesystem::parent_path(Sysutil::this_program_path()) + path;
 }
@@ -307,13 +1166,78 @@ combine_path(const std::string& path, const std::string& filename)
 {
     return path + "/" + filename;
 }
-// braw metadata
 
-// utils - metadata
-struct BrawMetadata {
-    std::string key;
-    std::string name;
-    TypeDesc type;
+// utils - output
+struct BrawDatatype {
+    TypeDesc format;
+    int bitspersample;
+};
+
+bool
+datatype_by_str(const std::string& datatype, BrawDatatype& result)
+{
+    static const std::map<std::string, BrawDatatype> datatypes = {
+        { "uint8", { TypeDesc::UINT8, 8 } },    { "uint10", { TypeDesc::UINT16, 10 } },
+        { "uint12", { TypeDesc::UINT16, 12 } }, { "uint16", { TypeDesc::UINT16, 16 } },
+        { "half", { TypeDesc::HALF, 16 } },     { "float", { TypeDesc::FLOAT, 32 } },
+    };
+    auto it = datatypes.find(datatype);
+    if (it == datatypes.end()) {
+        return false;
+    }
+    result = it->second;
+    return true;
+}
+
+std::string
+default_datatype(const std::string& outputformat)
+{
+    if (outputformat == "exr") {
+        return "half";  // float is twice the size without any gain for display referred previews
+    }
+    if (outputformat == "dpx") {
+        return "uint10";
+    }
+    return std::string();
+}
+
+bool
+packed_datatype(const std::string& outputformat)
+{
+    // formats that store 10 and 12 bit samples as such, others write them as 16 bit
+    return outputformat == "dpx" || outputformat == "tif" || outputformat == "tiff";
+}
+
+bool
+write_image(ImageBuf& imageBuf, const std::string& outputfilename, const std::string& outputformat,
+            const std::string& outputdatatype)
+{
+    std::string datatype = outputdatatype.size() ? outputdatatype : default_datatype(outputformat);
+    if (datatype.size()) {
+        BrawDatatype type;
+        if (!datatype_by_str(datatype, type)) {
+            return false;
+        }
+        imageBuf.set_write_format(type.format);
+        if ((type.bitspersample == 10 || type.bitspersample == 12) && packed_datatype(outputformat)) {
+            imageBuf.specmod().attribute("oiio:BitsPerSample", type.bitspersample);
+        }
+    }
+    if (tool.compression.size()) {
+        imageBuf.specmod().attribute("compression", tool.compression);
+    }
+    if (tool.tilesize > 0) {
+        imageBuf.set_write_tiles(tool.tilesize, tool.tilesize);  // ignored by formats without tile support
+    }
+    return imageBuf.write(outputfilename);
+}
+// braw metadata
+
+// utils - metadata
+struct BrawMetadata {
+    std::string key;
+    std::string name;
+    TypeDesc type;
     int x;
     int y;
 };
@@ -337,235 +1261,3278 @@ draw_metadata(ImageBuf& imageBuf, BrawMetadata metadata)
     return roi;
 }
 
-// braw callback
-class BrawCallback : public IBlackmagicRawCallback {
-public:
-    explicit BrawCallback() = default;
-    virtual ~BrawCallback()
-    {
-        assert(m_refCount == 0);
-        SetFrame(nullptr);
-        m_imageBuf.clear();
+// braw stats
+struct BrawStats {
+    static const int bins = 256;
+    static const int waveformwidth = 256;
+    static const int waveformlevels = 128;
+    int width = 0;
+    int height = 0;
+    uint64_t pixels = 0;
+    float min[3];
+    float max[3];
+    double sum[3];
+    uint64_t clipped[3];
+    uint64_t crushed[3];
+    uint64_t nonfinite[3];            // nan and inf samples, left out of every other statistic
+    std::vector<uint32_t> histogram;  // 3 x bins
+    std::vector<uint32_t> waveform;   // waveformwidth x waveformlevels of luma
+
+    void reset(int imagewidth, int imageheight)
+    {
+        width = imagewidth;
+        height = imageheight;
+        pixels = 0;
+        std::fill(min, min + 3, std::numeric_limits<float>::max());
+        std::fill(max, max + 3, std::numeric_limits<float>::lowest());
+        std::fill(sum, sum + 3, 0.0);
+        std::fill(clipped, clipped + 3, 0);
+        std::fill(crushed, crushed + 3, 0);
+        std::fill(nonfinite, nonfinite + 3, 0);
+        histogram.assign(3 * bins, 0);
+        waveform.assign(waveformwidth * waveformlevels, 0);
+    }
+
+    void add(const float* row, int count, int channels)
+    {
+        // min, max and sums over 4 pixels at a time with 12 independent lanes that vectorize,
+        // histogram and waveform are scatters and stay scalar.
+        const int lanes = 12;
+        float lanemin[lanes], lanemax[lanes], lanesum[lanes];
+        std::fill(lanemin, lanemin + lanes, std::numeric_limits<float>::max());
+        std::fill(lanemax, lanemax + lanes, std::numeric_limits<float>::lowest());
+        std::fill(lanesum, lanesum + lanes, 0.0f);
+        bool finite = true;
+        for (int i = 0; i < count * channels; i++) {
+            finite &= std::isfinite(row[i]);
+        }
+        int x = 0;
+        if (channels == 3 && finite) {
+            for (; x + 4 <= count; x += 4) {
+                const float* p = row + x * 3;
+                for (int k = 0; k < lanes; k++) {
+                    lanemin[k] = std::min(lanemin[k], p[k]);
+                    lanemax[k] = std::max(lanemax[k], p[k]);
+                    lanesum[k] += p[k];
+                }
+            }
+            for (int k = 0; k < lanes; k++) {
+                min[k % 3] = std::min(min[k % 3], lanemin[k]);
+                max[k % 3] = std::max(max[k % 3], lanemax[k]);
+                sum[k % 3] += lanesum[k];
+            }
+        }
+        for (int i = x; i < count; i++) {
+            const float* p = row + i * channels;
+            for (int c = 0; c < 3; c++) {
+                if (!finite && !std::isfinite(p[c])) {
+                    continue;
+                }
+                min[c] = std::min(min[c], p[c]);
+                max[c] = std::max(max[c], p[c]);
+                sum[c] += p[c];
+            }
+        }
+        for (int i = 0; i < count; i++) {
+            const float* p = row + i * channels;
+            bool pixelfinite = true;
+            for (int c = 0; c < 3; c++) {
+                if (!finite && !std::isfinite(p[c])) {
+                    nonfinite[c]++;
+                    pixelfinite = false;
+                    continue;
+                }
+                clipped[c] += p[c] >= 1.0f;
+                crushed[c] += p[c] <= 0.0f;
+                histogram[c * bins + bin(p[c], bins)]++;
+            }
+            if (!pixelfinite) {
+                continue;
+            }
+            float luma = 0.2126f * p[0] + 0.7152f * p[1] + 0.0722f * p[2];
+            int column = static_cast<int>(static_cast<int64_t>(i) * waveformwidth / width);
+            waveform[column * waveformlevels + bin(luma, waveformlevels)]++;
+        }
+        pixels += count;
+    }
+
+    void merge(const BrawStats& other)
+    {
+        for (int c = 0; c < 3; c++) {
+            min[c] = std::min(min[c], other.min[c]);
+            max[c] = std::max(max[c], other.max[c]);
+            sum[c] += other.sum[c];
+            clipped[c] += other.clipped[c];
+            crushed[c] += other.crushed[c];
+            nonfinite[c] += other.nonfinite[c];
+        }
+        for (size_t i = 0; i < histogram.size(); i++) {
+            histogram[i] += other.histogram[i];
+        }
+        for (size_t i = 0; i < waveform.size(); i++) {
+            waveform[i] += other.waveform[i];
+        }
+        pixels += other.pixels;
+    }
+
+    bool write(const std::string& filename) const
+    {
+        std::ofstream json(filename);
+        if (!json) {
+            return false;
+        }
+        const char* names[] = { "r", "g", "b" };
+        double count = static_cast<double>(std::max<uint64_t>(pixels, 1));
+        json << "{\n";
+        json << "    \"width\": " << width << ",\n";
+        json << "    \"height\": " << height << ",\n";
+        json << "    \"channels\": {\n";
+        for (int c = 0; c < 3; c++) {
+            json << "        \"" << names[c] << "\": {\n";
+            json << "            \"min\": " << min[c] << ",\n";
+            json << "            \"max\": " << max[c] << ",\n";
+            json << "            \"mean\": " << sum[c] / std::max(1.0, count - nonfinite[c]) << ",\n";
+            json << "            \"clipped_percent\": " << 100.0 * clipped[c] / count << ",\n";
+            json << "            \"crushed_percent\": " << 100.0 * crushed[c] / count << ",\n";
+            json << "            \"nonfinite\": " << nonfinite[c] << ",\n";
+            json << "            \"histogram\": [";
+            for (int i = 0; i < bins; i++) {
+                json << (i ? ", " : "") << histogram[c * bins + i];
+            }
+            json << "]\n";
+            json << "        }" << (c < 2 ? "," : "") << "\n";
+        }
+        json << "    },\n";
+        json << "    \"waveform\": {\n";
+        json << "        \"columns\": " << waveformwidth << ",\n";
+        json << "        \"levels\": " << waveformlevels << ",\n";
+        json << "        \"data\": [\n";
+        for (int x = 0; x < waveformwidth; x++) {
+            json << "            [";
+            for (int i = 0; i < waveformlevels; i++) {
+                json << (i ? ", " : "") << waveform[x * waveformlevels + i];
+            }
+            json << "]" << (x < waveformwidth - 1 ? "," : "") << "\n";
+        }
+        json << "        ]\n";
+        json << "    }\n";
+        json << "}\n";
+        return true;
+    }
+
+    static int bin(float value, int count)
+    {
+        // clamped in float, the cast of nan or values beyond the int range is undefined
+        float scaled = value * count;
+        return scaled > 0.0f ? static_cast<int>(std::min(scaled, count - 1.0f)) : 0;
+    }
+};
+
+// copies rows in parallel and gathers statistics in the same pass when requested, the source
+// stride allows copying a region out of a larger image
+void
+copy_pixels(float* dst, const float* src, int width, int height, int channels, size_t srcstride, BrawStats* stats)
+{
+    const int rows = 32;
+    int blocks = (height + rows - 1) / rows;
+    size_t stride = static_cast<size_t>(width) * channels;
+    if (stats) {
+        stats->reset(width, height);
+    }
+    std::mutex mutex;
+    parallel_for(0, blocks, [&](int64_t block) {
+        int ybegin = static_cast<int>(block) * rows;
+        int yend = std::min(height, ybegin + rows);
+        BrawStats blockstats;
+        if (stats) {
+            blockstats.reset(width, height);
+        }
+        for (int y = ybegin; y < yend; y++) {
+            const float* row = src + y * srcstride;
+            std::memcpy(dst + y * stride, row, stride * sizeof(float));
+            if (stats) {
+                blockstats.add(row, width, channels);
+            }
+        }
+        if (stats) {
+            std::lock_guard<std::mutex> lock(mutex);
+            stats->merge(blockstats);
+        }
+    });
+}
+
+// braw frame cache
+std::string
+cache_key(const std::string& inputfilename, long frame)
+{
+    // clip identity, frame, resolution scale, crop and the processing attributes set in ReadComplete,
+    // a change to any of them decodes the frame again.
+    std::string identity = hash_key(inputfilename);
+    if (!identity.size()) {
+        return std::string();
+    }
+    std::ostringstream stream;
+    stream << boost::filesystem::absolute(inputfilename).string() << ":" << identity << ":frame=" << frame
+           << ":scale=full";
+    stream << ":kelvin=" << (tool.kelvin.has_value() ? std::to_string(tool.kelvin.value()) : "clip");
+    stream << ":tint=" << (tool.tint.has_value() ? std::to_string(tool.tint.value()) : "clip");
+    stream << ":exposure=" << (tool.exposure.has_value() ? std::to_string(tool.exposure.value()) : "clip");
+    if (tool.crop.has_value()) {
+        const ROI& crop = tool.crop.value();
+        stream << ":crop=" << crop.xbegin << "," << crop.ybegin << "," << crop.width() << "," << crop.height();
+    }
+    std::string key = stream.str();
+
+    boost::uuids::detail::md5 hash;
+    boost::uuids::detail::md5::digest_type digest;
+    hash.process_bytes(key.data(), key.size());
+    hash.get_digest(digest);
+    const char* chardigest = reinterpret_cast<const char*>(&digest);
+    std::string result;
+    boost::algorithm::hex(chardigest, chardigest + sizeof(boost::uuids::detail::md5::digest_type),
+                          std::back_inserter(result));
+    return result;
+}
+
+bool
+read_cache(const std::string& cachefilename, ImageBuf& imageBuf, BrawStats* stats)
+{
+    ImageBuf cachebuf(cachefilename);
+    if (!cachebuf.read(0, 0, true, TypeDesc::FLOAT)) {
+        return false;
+    }
+    const ImageSpec& cachespec = cachebuf.spec();
+    ImageSpec spec(cachespec.width, cachespec.height, cachespec.nchannels, TypeDesc::FLOAT);
+    for (const ParamValue& param : cachespec.extra_attribs) {
+        std::string name = param.name().string();
+        if (Strutil::starts_with(name, "braw:")) {
+            spec.attribute(name.substr(5), param.type(), param.data());  // only clip and frame metadata
+        }
+    }
+    imageBuf = ImageBuf(spec, InitializePixels::No);
+    copy_pixels(static_cast<float*>(imageBuf.localpixels()), static_cast<const float*>(cachebuf.localpixels()),
+                spec.width, spec.height, spec.nchannels, static_cast<size_t>(spec.width) * spec.nchannels, stats);
+
+    boost::system::error_code error;
+    boost::filesystem::last_write_time(cachefilename, std::time(nullptr), error);  // most recently used
+    return true;
+}
+
+bool
+write_cache(const ImageBuf& imageBuf, const std::string& cachefilename)
+{
+    const ImageSpec& spec = imageBuf.spec();
+    ImageSpec cachespec(spec.width, spec.height, spec.nchannels, TypeDesc::HALF);
+    for (const ParamValue& param : spec.extra_attribs) {
+        cachespec.attribute("braw:" + param.name().string(), param.type(), param.data());
+    }
+    cachespec.attribute("compression", "zip");
+
+    // written to a process unique file and renamed, concurrent runs never read a partial frame
+    std::string tempfilename = cachefilename + "." + std::to_string(getpid()) + ".tmp.exr";
+    ImageOutput::unique_ptr output = ImageOutput::create(tempfilename);
+    if (!output || !output->open(tempfilename, cachespec)) {
+        return false;
+    }
+    bool written = output->write_image(TypeDesc::FLOAT, imageBuf.localpixels());
+    written = output->close() && written;
+    std::string error;
+    if (!written || !Filesystem::rename(tempfilename, cachefilename, error)) {
+        Filesystem::remove(tempfilename, error);
+        return false;
+    }
+    return true;
+}
+
+void
+evict_cache(const std::string& cachedirectory, uint64_t cachesize)
+{
+    // least recently used first, entries are touched on every cache hit
+    std::vector<std::tuple<std::time_t, uint64_t, boost::filesystem::path>> entries;
+    uint64_t size = 0;
+    boost::system::error_code error;
+    for (boost::filesystem::directory_iterator it(cachedirectory, error), end; !error && it != end;
+         it.increment(error)) {
+        const boost::filesystem::path& path = it->path();
+        if (path.extension() != ".exr" || path.stem().extension() == ".tmp") {
+            continue;
+        }
+        uint64_t filesize = boost::filesystem::file_size(path, error);
+        std::time_t filetime = boost::filesystem::last_write_time(path, error);
+        if (error) {
+            error.clear();
+            continue;
+        }
+        entries.emplace_back(filetime, filesize, path);
+        size += filesize;
+    }
+    std::sort(entries.begin(), entries.end());
+    for (size_t i = 0; i < entries.size() && size > cachesize; i++) {
+        print_info("evicting cached frame: ", std::get<2>(entries[i]).string());
+        if (boost::filesystem::remove(std::get<2>(entries[i]), error)) {
+            size -= std::get<1>(entries[i]);
+        }
+    }
+}
+
+#if defined(BlackmagicRaw_FOUND)
+// braw callback
+class BrawCallback : public IBlackmagicRawCallback {
+public:
+    explicit BrawCallback() = default;
+    virtual ~BrawCallback()
+    {
+        assert(m_refCount == 0);
+        SetFrame(nullptr);
+        m_imageBuf.clear();
+    }
+
+    virtual void ReadComplete(IBlackmagicRawJob* job, HRESULT result, IBlackmagicRawFrame* frame)
+    {
+        BlackmagicRawResourceFormat format = blackmagicRawResourceFormatRGBF32;  // we always read float 32
+        void* userData = nullptr;
+        job->GetUserData(&userData);
+        if (result == S_OK) {
+            frame->SetResourceFormat(format);
+        }
+        if (result == S_OK && m_scale.has_value()) {
+            frame->SetResolutionScale(m_scale.value());
+        }
+        if (userData) {
+            // streamed frames are decoded straight into their reorder buffer slot
+            ImageBuf* imageBuf = static_cast<ImageBuf*>(userData);
+            if (result == S_OK) {
+                result = SubmitDecodeAndProcess(frame, m_kelvin, m_tint, m_exposure, imageBuf);
+            }
+            if (result != S_OK) {
+                Processed(imageBuf, false);
+            }
+            job->Release();
+            return;
+        }
+        if (result == S_OK && m_readOnly) {
+            SetFrame(frame);  // frame metadata only, nothing is decoded
+            job->Release();
+            return;
+        }
+        if (result == S_OK) {
+            result = SubmitDecodeAndProcess(frame, m_kelvin, m_tint, m_exposure, nullptr);
+        }
+        // wedges are decoded concurrently from the same frame read
+        for (size_t i = 0; result == S_OK && i < m_wedges.size(); i++) {
+            const BrawWedge& wedge = m_wedges[i];
+            result = SubmitDecodeAndProcess(frame, wedge.kelvin ? wedge.kelvin : m_kelvin,
+                                            wedge.tint ? wedge.tint : m_tint,
+                                            wedge.exposure ? wedge.exposure : m_exposure, &m_wedgeBufs[i]);
+        }
+        if (result == S_OK) {
+            SetFrame(frame);
+        }
+        job->Release();
+    }
+
+    HRESULT SubmitDecodeAndProcess(IBlackmagicRawFrame* frame, boost::optional<int> kelvin,
+                                   boost::optional<int> tint, boost::optional<float> exposure, ImageBuf* imageBuf)
+    {
+        IBlackmagicRawJob* decodeAndProcessJob = nullptr;
+        IBlackmagicRawFrameProcessingAttributes* frameProcessingAttributes;
+        frame->CloneFrameProcessingAttributes(&frameProcessingAttributes);
+        if (kelvin.has_value()) {
+            Variant variant;
+            variant.vt = blackmagicRawVariantTypeU32;
+            variant.uintVal = kelvin.value();
+            frameProcessingAttributes->SetFrameAttribute(blackmagicRawFrameProcessingAttributeWhiteBalanceKelvin,
+                                                         &variant);
+        }
+        if (tint.has_value()) {
+            Variant variant;
+            variant.vt = blackmagicRawVariantTypeS16;
+            variant.uintVal = tint.value();
+            frameProcessingAttributes->SetFrameAttribute(blackmagicRawFrameProcessingAttributeWhiteBalanceTint,
+                                                         &variant);
+        }
+        if (exposure.has_value()) {
+            Variant variant;
+            variant.vt = blackmagicRawVariantTypeFloat32;
+            variant.fltVal = exposure.value();
+            frameProcessingAttributes->SetFrameAttribute(blackmagicRawFrameProcessingAttributeExposure, &variant);
+        }
+        HRESULT result = frame->CreateJobDecodeAndProcessFrame(nullptr, frameProcessingAttributes,
+                                                               &decodeAndProcessJob);
+        if (result == S_OK) {
+            result = decodeAndProcessJob->SetUserData(imageBuf);  // nullptr for the main decode
+        }
+        if (result == S_OK) {
+            result = decodeAndProcessJob->Submit();
+        }
+        if (result != S_OK) {
+            if (decodeAndProcessJob)
+                decodeAndProcessJob->Release();
+        }
+        return result;
+    }
+
+    virtual void ProcessComplete(IBlackmagicRawJob* job, HRESULT result, IBlackmagicRawProcessedImage* processedImage)
+    {
+        unsigned int width = 0;
+        unsigned int height = 0;
+        unsigned int sizeBytes = 0;
+        void* imageData = nullptr;
+        void* userData = nullptr;
+        job->GetUserData(&userData);
+        if (result == S_OK) {
+            result = processedImage->GetWidth(&width);
+        }
+        if (result == S_OK) {
+            result = processedImage->GetHeight(&height);
+        }
+        if (result == S_OK) {
+            result = processedImage->GetResourceSizeBytes(&sizeBytes);
+        }
+        if (result == S_OK) {
+            result = processedImage->GetResource(&imageData);
+        }
+        if (result == S_OK) {
+            if (userData) {
+                ProcessImage(width, height, sizeBytes, imageData, *static_cast<ImageBuf*>(userData), nullptr);
+            }
+            else {
+                ProcessImage(width, height, sizeBytes, imageData, m_imageBuf, m_stats);
+            }
+        }
+        if (userData) {
+            Processed(static_cast<ImageBuf*>(userData), result == S_OK);
+        }
+        job->Release();
+    }
+
+    void Processed(ImageBuf* imageBuf, bool processed)
+    {
+        if (m_processed) {
+            m_processed(imageBuf, processed);
+        }
+    }
+
+    virtual void ProcessImage(uint32_t width, uint32_t height, uint32_t size, void* image, ImageBuf& imageBuf,
+                              BrawStats* stats)
+    {
+        const int channels = 3;
+        const OIIO::TypeDesc format = OIIO::TypeDesc::FLOAT;
+        ROI roi(0, width, 0, height);
+        if (m_crop.has_value()) {
+            roi = roi_intersection(m_crop.value(), roi);  // only the crop is copied out of the resource
+        }
+        ImageSpec spec(roi.width(), roi.height(), channels, format);
+        std::shared_ptr<float> lease = bufferpool.acquire(spec.image_pixels() * channels);
+        imageBuf = ImageBuf(spec, lease.get());
+        {
+            std::lock_guard<std::mutex> lock(m_leaseMutex);
+            m_leases[&imageBuf] = lease;  // a reused stream slot returns its previous buffer
+        }
+        const float* pixels = static_cast<const float*>(image)
+                              + (static_cast<size_t>(roi.ybegin) * width + roi.xbegin) * channels;
+        copy_pixels(static_cast<float*>(imageBuf.localpixels()), pixels, roi.width(), roi.height(), channels,
+                    static_cast<size_t>(width) * channels, stats);
+    }
+
+    void ProcessMetaData(IBlackmagicRawMetadataIterator* metadataIterator)
+    {
+        char buffer[m_buffersize];
+        const char* str = nullptr;
+        CFStringRef key = nullptr;
+        Variant value;
+        HRESULT result;
+        std::string attribute;
+        while (SUCCEEDED(metadataIterator->GetKey(&key))) {
+            if (CFStringGetCString(key, buffer, m_buffersize, kCFStringEncodingMacRoman)) {
+                str = buffer;
+                attribute.clear();
+                attribute += str;
+            }
+            VariantInit(&value);
+            result = metadataIterator->GetData(&value);
+            if (result != S_OK) {
+                print_warning("could not get data from meta data iterator");
+                break;
+            }
+            BlackmagicRawVariantType variantType = value.vt;
+            std::ostringstream valueStream;
+            switch (variantType) {
+            case blackmagicRawVariantTypeS16: m_imageBuf.specmod().attribute(attribute, value.iVal); break;
+            case blackmagicRawVariantTypeU16: m_imageBuf.specmod().attribute(attribute, value.uiVal); break;
+            case blackmagicRawVariantTypeS32: m_imageBuf.specmod().attribute(attribute, value.intVal); break;
+            case blackmagicRawVariantTypeU32: m_imageBuf.specmod().attribute(attribute, value.uintVal); break;
+            case blackmagicRawVariantTypeFloat32: m_imageBuf.specmod().attribute(attribute, value.fltVal); break;
+            case blackmagicRawVariantTypeString:
+                if (CFStringGetCString(value.bstrVal, buffer, m_buffersize, kCFStringEncodingMacRoman)) {
+                    m_imageBuf.specmod().attribute(attribute, buffer);
+                }
+                break;
+            case blackmagicRawVariantTypeSafeArray: {
+                SafeArray* safeArray = value.parray;
+                void* safeArrayData = nullptr;
+                result = SafeArrayAccessData(safeArray, &safeArrayData);
+                if (result != S_OK) {
+                    print_warning("could not get safe array access in meta data iterator");
+                    break;
+                }
+
+                BlackmagicRawVariantType arrayVarType;
+                result = SafeArrayGetVartype(safeArray, &arrayVarType);
+                if (result != S_OK) {
+                    print_warning("could not get variant type from safe array in meta data iterator");
+                    SafeArrayUnaccessData(safeArray);
+                    break;
+                }
+                long lBound, uBound;
+                SafeArrayGetLBound(safeArray, 1, &lBound);
+                SafeArrayGetUBound(safeArray, 1, &uBound);
+                std::ostringstream arrayValues;
+                for (long i = lBound; i <= uBound; i++) {
+                    switch (arrayVarType) {
+                    case blackmagicRawVariantTypeU8:
+                        arrayValues << static_cast<unsigned char*>(safeArrayData)[i - lBound];
+                        break;
+                    case blackmagicRawVariantTypeS16:
+                        arrayValues << static_cast<short*>(safeArrayData)[i - lBound];
+                        break;
+                    case blackmagicRawVariantTypeU16:
+                        arrayValues << static_cast<unsigned short*>(safeArrayData)[i - lBound];
+                        break;
+                    case blackmagicRawVariantTypeS32:
+                        arrayValues << static_cast<int*>(safeArrayData)[i - lBound];
+                        break;
+                    case blackmagicRawVariantTypeU32:
+                        arrayValues << static_cast<unsigned int*>(safeArrayData)[i - lBound];
+                        break;
+                    case blackmagicRawVariantTypeFloat32:
+                        arrayValues << static_cast<float*>(safeArrayData)[i - lBound];
+                        break;
+                    }
+                    if (i < uBound)
+                        arrayValues << ", ";  // Add a comma except for the last element
+                }
+                SafeArrayUnaccessData(safeArray);
+                m_imageBuf.specmod().attribute(attribute, arrayValues.str());
+            } break;
+            default: break;
+            }
+            VariantClear(&value);
+            metadataIterator->Next();
+        }
+    }
+    virtual void DecodeComplete(IBlackmagicRawJob*, HRESULT) {}
+    virtual void TrimProgress(IBlackmagicRawJob*, float progress)
+    {
+        int percent = static_cast<int>(progress * 100.0f);
+        if (percent / 10 > m_trimProgress / 10) {
+            print_info("trim progress: ", str_by_int(percent) + "%");
+        }
+        m_trimProgress = percent;
+    }
+
+    virtual void TrimComplete(IBlackmagicRawJob* job, HRESULT result)
+    {
+        m_trimResult = result;
+        job->Release();
+    }
+    virtual void SidecarMetadataParseWarning(IBlackmagicRawClip*, CFStringRef, uint32_t, CFStringRef) {}
+    virtual void SidecarMetadataParseError(IBlackmagicRawClip*, CFStringRef, uint32_t, CFStringRef) {}
+    virtual void PreparePipelineComplete(void*, HRESULT) {}
+    virtual HRESULT STDMETHODCALLTYPE QueryInterface(REFIID, LPVOID*) { return E_NOTIMPL; }
+    virtual ULONG STDMETHODCALLTYPE AddRef(void) { return ++m_refCount; }
+
+    virtual ULONG STDMETHODCALLTYPE Release(void)
+    {
+        const int32_t newRefValue = --m_refCount;
+        if (newRefValue == 0) {
+            delete this;
+        }
+        assert(newRefValue >= 0);
+        return newRefValue;
+    }
+    float GetKelvin() const { return m_kelvin.value(); }
+    void SetKelvin(float kelvin) { m_kelvin = kelvin; }
+    float GetTint() const { return m_tint.value(); }
+    void SetTint(float tint) { m_tint = tint; }
+    float GetExposure() const { return m_exposure.value(); }
+    void SetExposure(float exposure) { m_exposure = exposure; }
+    ImageBuf GetImageBuf() { return m_imageBuf; }
+    void SetImageBuf(const ImageBuf& imageBuf) { m_imageBuf = imageBuf; }
+    void SetStats(BrawStats* stats) { m_stats = stats; }
+    void SetCrop(const ROI& crop) { m_crop = crop; }
+    void SetResolutionScale(BlackmagicRawResolutionScale scale) { m_scale = scale; }
+    void SetReadOnly(bool readOnly) { m_readOnly = readOnly; }
+    void SetWedges(const std::vector<BrawWedge>& wedges)
+    {
+        m_wedges = wedges;
+        m_wedgeBufs.assign(wedges.size(), ImageBuf());
+    }
+    void SetProcessed(std::function<void(ImageBuf*, bool)> processed) { m_processed = processed; }
+    std::vector<ImageBuf> TakeWedgeBufs() { return std::move(m_wedgeBufs); }  // moved, wedges can be large
+    std::vector<std::shared_ptr<float>> TakeLeases()
+    {
+        // pooled pixels of the decoded images, held by the caller for as long as the images are used
+        std::lock_guard<std::mutex> lock(m_leaseMutex);
+        std::vector<std::shared_ptr<float>> leases;
+        for (std::pair<ImageBuf* const, std::shared_ptr<float>>& lease : m_leases) {
+            leases.push_back(std::move(lease.second));
+        }
+        m_leases.clear();
+        return leases;
+    }
+    HRESULT GetTrimResult() const { return m_trimResult; }
+    IBlackmagicRawFrame* GetFrame() { return m_frame; }
+    void SetFrame(IBlackmagicRawFrame* frame)
+    {
+        if (m_frame != nullptr) {
+            m_frame->Release();
+        }
+        m_frame = frame;
+        if (m_frame != nullptr) {
+            m_frame->AddRef();
+        }
+    }
+
+private:
+    boost::optional<int> m_kelvin;
+    boost::optional<int> m_tint;
+    boost::optional<float> m_exposure;
+    IBlackmagicRawFrame* m_frame = nullptr;
+    ImageBuf m_imageBuf;
+    BrawStats* m_stats = nullptr;
+    boost::optional<ROI> m_crop;
+    boost::optional<BlackmagicRawResolutionScale> m_scale;
+    bool m_readOnly = false;
+    std::vector<BrawWedge> m_wedges;
+    std::vector<ImageBuf> m_wedgeBufs;
+    std::function<void(ImageBuf*, bool)> m_processed;
+    std::map<ImageBuf*, std::shared_ptr<float>> m_leases;
+    std::mutex m_leaseMutex;
+    HRESULT m_trimResult = E_FAIL;
+    int m_trimProgress = 0;
+    std::atomic<int32_t> m_refCount = { 0 };
+    const int m_buffersize = 1024;
+};
+
+// braw references, released on every return path so failed clips do not hold on to the kept codec
+struct BrawRelease {
+    template<class T> void operator()(T* object) const { object->Release(); }
+};
+template<class T> using BrawRef = std::unique_ptr<T, BrawRelease>;
+
+struct BrawCallbackRelease {
+    IBlackmagicRaw* codec = nullptr;
+    void operator()(BrawCallback* callback) const
+    {
+        if (codec != nullptr) {
+            codec->SetCallback(nullptr);
+        }
+        callback->SetFrame(nullptr);  // needed to force codec to release callback, reported to bm support
+        callback->Release();
+    }
+};
+using BrawCallbackRef = std::unique_ptr<BrawCallback, BrawCallbackRelease>;
+
+void
+configure_callback(BrawCallback* callback, BrawStats* stats, const boost::optional<ROI>& crop)
+{
+    if (tool.kelvin.has_value()) {
+        callback->SetKelvin(tool.kelvin.value());
+    }
+    if (tool.tint.has_value()) {
+        callback->SetTint(tool.tint.value());
+    }
+    if (tool.exposure.has_value()) {
+        callback->SetExposure(tool.exposure.value());
+    }
+    if (stats) {
+        callback->SetStats(stats);
+    }
+    if (crop.has_value()) {
+        callback->SetCrop(crop.value());
+    }
+}
+
+// braw audio
+static void
+write_le(std::ofstream& file, uint64_t value, int bytes)
+{
+    for (int i = 0; i < bytes; i++) {
+        file.put(static_cast<char>((value >> (8 * i)) & 0xff));
+    }
+}
+
+static void
+write_field(std::ofstream& file, const std::string& str, size_t size)
+{
+    std::string field = str.substr(0, size);
+    field.resize(size, '\0');  // fixed size fields are zero padded
+    file.write(field.data(), field.size());
+}
+
+std::string
+extract_audio(IBlackmagicRawClip* clip, const std::string& inputfilename, const std::string& outputfilename)
+{
+    IBlackmagicRawClipAudio* audio = nullptr;
+    if (clip->QueryInterface(IID_IBlackmagicRawClipAudio, reinterpret_cast<LPVOID*>(&audio)) != S_OK || !audio) {
+        print_warning("could not find audio in input filename: ", inputfilename);
+        return std::string();
+    }
+    BlackmagicRawAudioFormat format;
+    uint32_t bitdepth = 0;
+    uint32_t channels = 0;
+    uint32_t samplerate = 0;
+    uint64_t samplecount = 0;
+    HRESULT result = audio->GetAudioFormat(&format);
+    if (result == S_OK) {
+        result = audio->GetAudioBitDepth(&bitdepth);
+    }
+    if (result == S_OK) {
+        result = audio->GetAudioChannelCount(&channels);
+    }
+    if (result == S_OK) {
+        result = audio->GetAudioSampleRate(&samplerate);
+    }
+    if (result == S_OK) {
+        result = audio->GetAudioSampleCount(&samplecount);
+    }
+    if (result != S_OK || format != blackmagicRawAudioFormatPCMLittleEndian) {
+        audio->Release();
+        return "unsupported audio format in input filename: " + inputfilename;
+    }
+    if (!samplecount || !channels) {
+        audio->Release();
+        print_warning("could not find audio samples in input filename: ", inputfilename);
+        return std::string();
+    }
+
+    const uint32_t bextsize = 602;
+    uint32_t blockalign = channels * ((bitdepth + 7) / 8);
+    uint64_t datasize = samplecount * blockalign;
+    uint64_t padding = datasize & 1;  // chunks are word aligned
+    uint64_t riffsize = 4 + (8 + bextsize) + (8 + 16) + (8 + datasize + padding);
+    if (riffsize > std::numeric_limits<uint32_t>::max()) {
+        audio->Release();
+        return "audio exceeds the 4GB wav size limit in input filename: " + inputfilename;
+    }
+    std::ofstream file(outputfilename, std::ios::binary);
+    if (!file) {
+        audio->Release();
+        return "could not open audio file: " + outputfilename;
+    }
+    std::string date = datetime();
+    file.write("RIFF", 4);
+    write_le(file, riffsize, 4);
+    file.write("WAVE", 4);
+
+    // broadcast wave extension
+    file.write("bext", 4);
+    write_le(file, bextsize, 4);
+    write_field(file, filename(inputfilename), 256);  // description
+    write_field(file, "brawtool", 32);                // originator
+    write_field(file, "", 32);                        // originator reference
+    write_field(file, date.substr(0, 10), 10);
+    write_field(file, date.substr(11, 8), 8);
+    write_le(file, 0, 8);                   // time reference, samples since midnight
+    write_le(file, 1, 2);                   // version
+    write_field(file, "", 64 + 10 + 180);  // umid, loudness and reserved
+
+    file.write("fmt ", 4);
+    write_le(file, 16, 4);
+    write_le(file, 1, 2);  // pcm
+    write_le(file, channels, 2);
+    write_le(file, samplerate, 4);
+    write_le(file, static_cast<uint64_t>(samplerate) * blockalign, 4);
+    write_le(file, blockalign, 2);
+    write_le(file, bitdepth, 2);
+
+    file.write("data", 4);
+    write_le(file, datasize, 4);
+
+    // bounded chunks through a reusable buffer, memory stays constant for long takes
+    const uint32_t chunksamples = 64 * 1024;
+    std::vector<char> buffer(static_cast<size_t>(chunksamples) * blockalign);
+    uint64_t samples = 0;
+    while (samples < samplecount && file) {
+        uint32_t samplesread = 0;
+        uint32_t bytesread = 0;
+        result = audio->GetAudioSamples(samples, buffer.data(), static_cast<uint32_t>(buffer.size()), chunksamples,
+                                        &samplesread, &bytesread);
+        if (result != S_OK || !samplesread) {
+            break;
+        }
+        file.write(buffer.data(), bytesread);
+        samples += samplesread;
+    }
+    audio->Release();
+    if (padding) {
+        file.put('\0');
+    }
+    if (samples < samplecount) {
+        return "could not read audio samples from input filename: " + inputfilename;
+    }
+    if (!file) {
+        return "could not write audio file: " + outputfilename;
+    }
+    print_info("extracted audio samples: ", std::to_string(samples) + " (" + str_by_int(channels) + " channels, "
+                                                + str_by_int(bitdepth) + " bit, " + str_by_int(samplerate) + " hz)");
+    return std::string();
+}
+#endif
+
+// braw colorspace
+struct BrawColorspace {
+    std::string description;
+    std::string filename;
+};
+
+bool
+read_colorspaces(const std::string& jsonfile, std::map<std::string, BrawColorspace>& colorspaces)
+{
+    std::ifstream json(jsonfile);
+    if (!json.is_open()) {
+        return false;
+    }
+    ptree pt;
+    read_json(jsonfile, pt);
+    for (const std::pair<const ptree::key_type, ptree>& item : pt) {
+        std::string name = item.first;
+        const ptree data = item.second;
+
+        BrawColorspace colorspace {
+            resources_path(data.get<std::string>("description", "")),
+            resources_path(data.get<std::string>("filename", "")),
+        };
+
+        if (!Filesystem::exists(colorspace.filename)) {
+            print_warning("'filename' does not exist for colorspace: ", colorspace.filename);
+            continue;
+        }
+
+        colorspaces[name] = colorspace;
+    }
+    return true;
+}
+
+// braw 3dlut
+struct Braw3DLutData {
+    int size = 0;
+    const float* table = nullptr;  // rgb triplets, red changing fastest
+    float scale[3];
+    float offset[3];
+};
+
+enum class Braw3DLutIsa { Scalar, SSE41, AVX2, AVX512 };
+
+typedef void (*Braw3DLutKernel)(const Braw3DLutData& lut, float* pixels, size_t count, int channels);
+
+// tetrahedral interpolation, the cube is split along the sorted fractions so that each
+// pixel blends the base corner, the corner of the largest fraction, the corner of the
+// two largest fractions and the far corner.
+template<int N>
+static void
+lut3d_tetrahedral_scalar(const Braw3DLutData& lut, float* pixels, size_t count, int channels)
+{
+    const int size = N ? N : lut.size;  // constant folded for specialized sizes
+    const int dx = 3;
+    const int dy = 3 * size;
+    const int dz = 3 * size * size;
+    const float maxindex = static_cast<float>(size - 1);
+    const float* table = lut.table;
+    for (size_t i = 0; i < count; i++) {
+        float* p = pixels + i * channels;
+        float r = std::max(0.0f, std::min(p[0] * lut.scale[0] + lut.offset[0], maxindex));
+        float g = std::max(0.0f, std::min(p[1] * lut.scale[1] + lut.offset[1], maxindex));
+        float b = std::max(0.0f, std::min(p[2] * lut.scale[2] + lut.offset[2], maxindex));
+        int ri = std::min(static_cast<int>(r), size - 2);
+        int gi = std::min(static_cast<int>(g), size - 2);
+        int bi = std::min(static_cast<int>(b), size - 2);
+        float fr = r - ri;
+        float fg = g - gi;
+        float fb = b - bi;
+        bool xgey = fr >= fg;
+        bool ygez = fg >= fb;
+        bool xgez = fr >= fb;
+        int maxoffset = (xgey && xgez) ? dx : (!xgey && ygez) ? dy : dz;
+        int minoffset = (!xgey && !xgez) ? dx : (xgey && !ygez) ? dy : dz;
+        float fmax = std::max(fr, std::max(fg, fb));
+        float fmin = std::min(fr, std::min(fg, fb));
+        float fmid = fr + fg + fb - fmax - fmin;
+        const float* c0 = table + ri * dx + gi * dy + bi * dz;
+        const float* c1 = c0 + maxoffset;
+        const float* c2 = c0 + (dx + dy + dz - minoffset);
+        const float* c3 = c0 + (dx + dy + dz);
+        float w0 = 1.0f - fmax;
+        float w1 = fmax - fmid;
+        float w2 = fmid - fmin;
+        float w3 = fmin;
+        for (int c = 0; c < 3; c++) {
+            p[c] = w0 * c0[c] + w1 * c1[c] + w2 * c2[c] + w3 * c3[c];
+        }
+    }
+}
+
+#if defined(__x86_64__) || defined(_M_X64)
+template<int N>
+__attribute__((target("sse4.1"))) static void
+lut3d_tetrahedral_sse41(const Braw3DLutData& lut, float* pixels, size_t count, int channels)
+{
+    const int size = N ? N : lut.size;
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 maxindex = _mm_set1_ps(static_cast<float>(size - 1));
+    const __m128i maxbase = _mm_set1_epi32(size - 2);
+    const __m128i dx = _mm_set1_epi32(3);
+    const __m128i dy = _mm_set1_epi32(3 * size);
+    const __m128i dz = _mm_set1_epi32(3 * size * size);
+    const __m128i dxyz = _mm_set1_epi32(3 + 3 * size + 3 * size * size);
+    const float* table = lut.table;
+    alignas(16) float in[3][4];
+    alignas(16) float out[3][4];
+    alignas(16) int32_t index[4][4];
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        float* p = pixels + i * channels;
+        for (int k = 0; k < 4; k++) {
+            in[0][k] = p[k * channels + 0];
+            in[1][k] = p[k * channels + 1];
+            in[2][k] = p[k * channels + 2];
+        }
+        __m128 v[3];
+        __m128i vi[3];
+        __m128 f[3];
+        for (int c = 0; c < 3; c++) {
+            v[c] = _mm_add_ps(_mm_mul_ps(_mm_load_ps(in[c]), _mm_set1_ps(lut.scale[c])), _mm_set1_ps(lut.offset[c]));
+            v[c] = _mm_min_ps(_mm_max_ps(v[c], zero), maxindex);
+            vi[c] = _mm_min_epi32(_mm_cvttps_epi32(v[c]), maxbase);
+            f[c] = _mm_sub_ps(v[c], _mm_cvtepi32_ps(vi[c]));
+        }
+        __m128i base = _mm_add_epi32(_mm_add_epi32(_mm_mullo_epi32(vi[0], dx), _mm_mullo_epi32(vi[1], dy)),
+                                     _mm_mullo_epi32(vi[2], dz));
+        __m128i xgey = _mm_castps_si128(_mm_cmpge_ps(f[0], f[1]));
+        __m128i ygez = _mm_castps_si128(_mm_cmpge_ps(f[1], f[2]));
+        __m128i xgez = _mm_castps_si128(_mm_cmpge_ps(f[0], f[2]));
+        __m128i maxisx = _mm_and_si128(xgey, xgez);
+        __m128i maxisy = _mm_andnot_si128(xgey, ygez);
+        __m128i minisx = _mm_andnot_si128(_mm_or_si128(xgey, xgez), _mm_set1_epi32(-1));
+        __m128i minisy = _mm_andnot_si128(ygez, xgey);
+        __m128i maxoffset = _mm_blendv_epi8(_mm_blendv_epi8(dz, dy, maxisy), dx, maxisx);
+        __m128i minoffset = _mm_blendv_epi8(_mm_blendv_epi8(dz, dy, minisy), dx, minisx);
+        __m128 fmax = _mm_max_ps(f[0], _mm_max_ps(f[1], f[2]));
+        __m128 fmin = _mm_min_ps(f[0], _mm_min_ps(f[1], f[2]));
+        __m128 fmid = _mm_sub_ps(_mm_sub_ps(_mm_add_ps(f[0], _mm_add_ps(f[1], f[2])), fmax), fmin);
+        __m128 w0 = _mm_sub_ps(one, fmax);
+        __m128 w1 = _mm_sub_ps(fmax, fmid);
+        __m128 w2 = _mm_sub_ps(fmid, fmin);
+        __m128 w3 = fmin;
+        _mm_store_si128(reinterpret_cast<__m128i*>(index[0]), base);
+        _mm_store_si128(reinterpret_cast<__m128i*>(index[1]), _mm_add_epi32(base, maxoffset));
+        _mm_store_si128(reinterpret_cast<__m128i*>(index[2]), _mm_add_epi32(base, _mm_sub_epi32(dxyz, minoffset)));
+        _mm_store_si128(reinterpret_cast<__m128i*>(index[3]), _mm_add_epi32(base, dxyz));
+        for (int c = 0; c < 3; c++) {
+            const float* t = table + c;
+            __m128 c0 = _mm_setr_ps(t[index[0][0]], t[index[0][1]], t[index[0][2]], t[index[0][3]]);
+            __m128 c1 = _mm_setr_ps(t[index[1][0]], t[index[1][1]], t[index[1][2]], t[index[1][3]]);
+            __m128 c2 = _mm_setr_ps(t[index[2][0]], t[index[2][1]], t[index[2][2]], t[index[2][3]]);
+            __m128 c3 = _mm_setr_ps(t[index[3][0]], t[index[3][1]], t[index[3][2]], t[index[3][3]]);
+            __m128 result = _mm_add_ps(_mm_add_ps(_mm_mul_ps(w0, c0), _mm_mul_ps(w1, c1)),
+                                       _mm_add_ps(_mm_mul_ps(w2, c2), _mm_mul_ps(w3, c3)));
+            _mm_store_ps(out[c], result);
+        }
+        for (int k = 0; k < 4; k++) {
+            p[k * channels + 0] = out[0][k];
+            p[k * channels + 1] = out[1][k];
+            p[k * channels + 2] = out[2][k];
+        }
+    }
+    lut3d_tetrahedral_scalar<N>(lut, pixels + i * channels, count - i, channels);
+}
+
+template<int N>
+__attribute__((target("avx2,fma"))) static void
+lut3d_tetrahedral_avx2(const Braw3DLutData& lut, float* pixels, size_t count, int channels)
+{
+    const int size = N ? N : lut.size;
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 maxindex = _mm256_set1_ps(static_cast<float>(size - 1));
+    const __m256i maxbase = _mm256_set1_epi32(size - 2);
+    const __m256i dx = _mm256_set1_epi32(3);
+    const __m256i dy = _mm256_set1_epi32(3 * size);
+    const __m256i dz = _mm256_set1_epi32(3 * size * size);
+    const __m256i dxyz = _mm256_set1_epi32(3 + 3 * size + 3 * size * size);
+    const __m256i lanes = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(channels));
+    const float* table = lut.table;
+    alignas(32) float out[3][8];
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        float* p = pixels + i * channels;
+        __m256i vi[3];
+        __m256 f[3];
+        for (int c = 0; c < 3; c++) {
+            __m256 v = _mm256_i32gather_ps(p + c, lanes, 4);
+            v = _mm256_fmadd_ps(v, _mm256_set1_ps(lut.scale[c]), _mm256_set1_ps(lut.offset[c]));
+            v = _mm256_min_ps(_mm256_max_ps(v, zero), maxindex);
+            vi[c] = _mm256_min_epi32(_mm256_cvttps_epi32(v), maxbase);
+            f[c] = _mm256_sub_ps(v, _mm256_cvtepi32_ps(vi[c]));
+        }
+        __m256i base = _mm256_add_epi32(_mm256_add_epi32(_mm256_mullo_epi32(vi[0], dx), _mm256_mullo_epi32(vi[1], dy)),
+                                        _mm256_mullo_epi32(vi[2], dz));
+        __m256i xgey = _mm256_castps_si256(_mm256_cmp_ps(f[0], f[1], _CMP_GE_OQ));
+        __m256i ygez = _mm256_castps_si256(_mm256_cmp_ps(f[1], f[2], _CMP_GE_OQ));
+        __m256i xgez = _mm256_castps_si256(_mm256_cmp_ps(f[0], f[2], _CMP_GE_OQ));
+        __m256i maxisx = _mm256_and_si256(xgey, xgez);
+        __m256i maxisy = _mm256_andnot_si256(xgey, ygez);
+        __m256i minisx = _mm256_andnot_si256(_mm256_or_si256(xgey, xgez), _mm256_set1_epi32(-1));
+        __m256i minisy = _mm256_andnot_si256(ygez, xgey);
+        __m256i maxoffset = _mm256_blendv_epi8(_mm256_blendv_epi8(dz, dy, maxisy), dx, maxisx);
+        __m256i minoffset = _mm256_blendv_epi8(_mm256_blendv_epi8(dz, dy, minisy), dx, minisx);
+        __m256 fmax = _mm256_max_ps(f[0], _mm256_max_ps(f[1], f[2]));
+        __m256 fmin = _mm256_min_ps(f[0], _mm256_min_ps(f[1], f[2]));
+        __m256 fmid = _mm256_sub_ps(_mm256_sub_ps(_mm256_add_ps(f[0], _mm256_add_ps(f[1], f[2])), fmax), fmin);
+        __m256 w0 = _mm256_sub_ps(one, fmax);
+        __m256 w1 = _mm256_sub_ps(fmax, fmid);
+        __m256 w2 = _mm256_sub_ps(fmid, fmin);
+        __m256 w3 = fmin;
+        __m256i index1 = _mm256_add_epi32(base, maxoffset);
+        __m256i index2 = _mm256_add_epi32(base, _mm256_sub_epi32(dxyz, minoffset));
+        __m256i index3 = _mm256_add_epi32(base, dxyz);
+        for (int c = 0; c < 3; c++) {
+            const float* t = table + c;
+            __m256 result = _mm256_mul_ps(w0, _mm256_i32gather_ps(t, base, 4));
+            result = _mm256_fmadd_ps(w1, _mm256_i32gather_ps(t, index1, 4), result);
+            result = _mm256_fmadd_ps(w2, _mm256_i32gather_ps(t, index2, 4), result);
+            result = _mm256_fmadd_ps(w3, _mm256_i32gather_ps(t, index3, 4), result);
+            _mm256_store_ps(out[c], result);
+        }
+        for (int k = 0; k < 8; k++) {
+            p[k * channels + 0] = out[0][k];
+            p[k * channels + 1] = out[1][k];
+            p[k * channels + 2] = out[2][k];
+        }
+    }
+    lut3d_tetrahedral_scalar<N>(lut, pixels + i * channels, count - i, channels);
+}
+
+template<int N>
+__attribute__((target("avx512f"))) static void
+lut3d_tetrahedral_avx512(const Braw3DLutData& lut, float* pixels, size_t count, int channels)
+{
+    const int size = N ? N : lut.size;
+    const __m512 zero = _mm512_setzero_ps();
+    const __m512 one = _mm512_set1_ps(1.0f);
+    const __m512 maxindex = _mm512_set1_ps(static_cast<float>(size - 1));
+    const __m512i maxbase = _mm512_set1_epi32(size - 2);
+    const __m512i dx = _mm512_set1_epi32(3);
+    const __m512i dy = _mm512_set1_epi32(3 * size);
+    const __m512i dz = _mm512_set1_epi32(3 * size * size);
+    const __m512i dxyz = _mm512_set1_epi32(3 + 3 * size + 3 * size * size);
+    const __m512i lanes = _mm512_mullo_epi32(_mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15),
+                                             _mm512_set1_epi32(channels));
+    const float* table = lut.table;
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        float* p = pixels + i * channels;
+        __m512i vi[3];
+        __m512 f[3];
+        for (int c = 0; c < 3; c++) {
+            __m512 v = _mm512_i32gather_ps(lanes, p + c, 4);
+            v = _mm512_fmadd_ps(v, _mm512_set1_ps(lut.scale[c]), _mm512_set1_ps(lut.offset[c]));
+            v = _mm512_min_ps(_mm512_max_ps(v, zero), maxindex);
+            vi[c] = _mm512_min_epi32(_mm512_cvttps_epi32(v), maxbase);
+            f[c] = _mm512_sub_ps(v, _mm512_cvtepi32_ps(vi[c]));
+        }
+        __m512i base = _mm512_add_epi32(_mm512_add_epi32(_mm512_mullo_epi32(vi[0], dx), _mm512_mullo_epi32(vi[1], dy)),
+                                        _mm512_mullo_epi32(vi[2], dz));
+        __mmask16 xgey = _mm512_cmp_ps_mask(f[0], f[1], _CMP_GE_OQ);
+        __mmask16 ygez = _mm512_cmp_ps_mask(f[1], f[2], _CMP_GE_OQ);
+        __mmask16 xgez = _mm512_cmp_ps_mask(f[0], f[2], _CMP_GE_OQ);
+        __mmask16 maxisx = xgey & xgez;
+        __mmask16 maxisy = ~xgey & ygez;
+        __mmask16 minisx = ~xgey & ~xgez;
+        __mmask16 minisy = xgey & ~ygez;
+        __m512i maxoffset = _mm512_mask_blend_epi32(maxisx, _mm512_mask_blend_epi32(maxisy, dz, dy), dx);
+        __m512i minoffset = _mm512_mask_blend_epi32(minisx, _mm512_mask_blend_epi32(minisy, dz, dy), dx);
+        __m512 fmax = _mm512_max_ps(f[0], _mm512_max_ps(f[1], f[2]));
+        __m512 fmin = _mm512_min_ps(f[0], _mm512_min_ps(f[1], f[2]));
+        __m512 fmid = _mm512_sub_ps(_mm512_sub_ps(_mm512_add_ps(f[0], _mm512_add_ps(f[1], f[2])), fmax), fmin);
+        __m512 w0 = _mm512_sub_ps(one, fmax);
+        __m512 w1 = _mm512_sub_ps(fmax, fmid);
+        __m512 w2 = _mm512_sub_ps(fmid, fmin);
+        __m512 w3 = fmin;
+        __m512i index1 = _mm512_add_epi32(base, maxoffset);
+        __m512i index2 = _mm512_add_epi32(base, _mm512_sub_epi32(dxyz, minoffset));
+        __m512i index3 = _mm512_add_epi32(base, dxyz);
+        for (int c = 0; c < 3; c++) {
+            const float* t = table + c;
+            __m512 result = _mm512_mul_ps(w0, _mm512_i32gather_ps(base, t, 4));
+            result = _mm512_fmadd_ps(w1, _mm512_i32gather_ps(index1, t, 4), result);
+            result = _mm512_fmadd_ps(w2, _mm512_i32gather_ps(index2, t, 4), result);
+            result = _mm512_fmadd_ps(w3, _mm512_i32gather_ps(index3, t, 4), result);
+            _mm512_i32scatter_ps(p + c, lanes, result, 4);
+        }
+    }
+    lut3d_tetrahedral_scalar<N>(lut, pixels + i * channels, count - i, channels);
+}
+#endif
+
+template<int N>
+static Braw3DLutKernel
+lut3d_kernel(Braw3DLutIsa isa)
+{
+#if defined(__x86_64__) || defined(_M_X64)
+    switch (isa) {
+    case Braw3DLutIsa::AVX512: return lut3d_tetrahedral_avx512<N>;
+    case Braw3DLutIsa::AVX2: return lut3d_tetrahedral_avx2<N>;
+    case Braw3DLutIsa::SSE41: return lut3d_tetrahedral_sse41<N>;
+    default: break;
+    }
+#endif
+    return lut3d_tetrahedral_scalar<N>;
+}
+
+static Braw3DLutKernel
+lut3d_kernel(int size, Braw3DLutIsa isa)
+{
+    switch (size) {
+    case 17: return lut3d_kernel<17>(isa);
+    case 33: return lut3d_kernel<33>(isa);
+    case 65: return lut3d_kernel<65>(isa);
+    default: return lut3d_kernel<0>(isa);
+    }
+}
+
+static std::vector<Braw3DLutIsa>
+lut3d_isas()
+{
+    std::vector<Braw3DLutIsa> isas = { Braw3DLutIsa::Scalar };
+#if defined(__x86_64__) || defined(_M_X64)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.1")) {
+        isas.push_back(Braw3DLutIsa::SSE41);
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        isas.push_back(Braw3DLutIsa::AVX2);
+    }
+    if (__builtin_cpu_supports("avx512f")) {
+        isas.push_back(Braw3DLutIsa::AVX512);
+    }
+#endif
+    return isas;
+}
+
+static std::string
+lut3d_isa_str(Braw3DLutIsa isa)
+{
+    switch (isa) {
+    case Braw3DLutIsa::SSE41: return "sse4.1";
+    case Braw3DLutIsa::AVX2: return "avx2";
+    case Braw3DLutIsa::AVX512: return "avx512";
+    default: return "scalar";
+    }
+}
+
+class Braw3DLut {
+public:
+    bool read(const std::string& filename)
+    {
+        std::ifstream file(filename);
+        if (!file.is_open()) {
+            return false;
+        }
+        int size = 0;
+        float domainmin[3] = { 0.0f, 0.0f, 0.0f };
+        float domainmax[3] = { 1.0f, 1.0f, 1.0f };
+        std::vector<float> table;
+        std::string line;
+        while (getline(file, line)) {
+            std::istringstream stream(line);
+            std::string keyword;
+            if (!(stream >> keyword) || keyword[0] == '#') {
+                continue;
+            }
+            if (keyword == "LUT_3D_SIZE") {
+                stream >> size;
+                if (size < 2 || size > 256) {
+                    return false;
+                }
+                table.reserve(3 * size * size * size);
+            }
+            else if (keyword == "DOMAIN_MIN") {
+                stream >> domainmin[0] >> domainmin[1] >> domainmin[2];
+            }
+            else if (keyword == "DOMAIN_MAX") {
+                stream >> domainmax[0] >> domainmax[1] >> domainmax[2];
+            }
+            else if (keyword == "LUT_3D_INPUT_RANGE") {
+                float min, max;
+                stream >> min >> max;
+                std::fill(domainmin, domainmin + 3, min);
+                std::fill(domainmax, domainmax + 3, max);
+            }
+            else if (keyword == "TITLE" || keyword == "BMD_TITLE") {
+                continue;
+            }
+            else if (std::isalpha(static_cast<unsigned char>(keyword[0]))) {
+                return false;  // shaper luts and unknown keywords are left to ocio
+            }
+            else {
+                float r = std::strtof(keyword.c_str(), nullptr);
+                float g, b;
+                stream >> g >> b;
+                table.push_back(r);
+                table.push_back(g);
+                table.push_back(b);
+            }
+        }
+        if (!size || table.size() != static_cast<size_t>(3 * size * size * size)) {
+            return false;
+        }
+        m_size = size;
+        m_table = std::move(table);
+        for (int c = 0; c < 3; c++) {
+            if (domainmax[c] <= domainmin[c]) {
+                return false;
+            }
+            m_scale[c] = (size - 1) / (domainmax[c] - domainmin[c]);
+            m_offset[c] = -domainmin[c] * m_scale[c];
+        }
+        return true;
+    }
+
+    void apply(float* pixels, size_t count, int channels, Braw3DLutIsa isa) const
+    {
+        Braw3DLutData data;
+        data.size = m_size;
+        data.table = m_table.data();
+        std::copy(m_scale, m_scale + 3, data.scale);
+        std::copy(m_offset, m_offset + 3, data.offset);
+        lut3d_kernel(m_size, isa)(data, pixels, count, channels);
+    }
+
+    int size() const { return m_size; }
+
+private:
+    int m_size = 0;
+    float m_scale[3];
+    float m_offset[3];
+    std::vector<float> m_table;
+};
+
+// utils - resize
+void
+fit_size(int imagewidth, int imageheight, const BrawVariant& variant, int& width, int& height, int& resizewidth,
+         int& resizeheight)
+{
+    float aspectratio = static_cast<float>(imagewidth) / imageheight;
+    width = variant.width.value_or(0);
+    height = variant.height.value_or(0);
+    if (width <= 0 && height <= 0) {
+        width = imagewidth;
+        height = imageheight;
+    }
+    else if (height <= 0) {
+        height = std::max(1, static_cast<int>(width / aspectratio));
+    }
+    else if (width <= 0) {
+        width = std::max(1, static_cast<int>(height * aspectratio));
+    }
+    float resizeaspectratio = static_cast<float>(width) / height;
+    if (aspectratio > resizeaspectratio) {
+        resizewidth = width;
+        resizeheight = std::max(1, static_cast<int>(width / aspectratio));
+    }
+    else {
+        resizewidth = std::max(1, static_cast<int>(height * aspectratio));
+        resizeheight = height;
+    }
+}
+
+void
+copy_attributes(ImageBuf& imageBuf, const ImageSpec& spec)
+{
+    for (const ParamValue& param : spec.extra_attribs) {
+        imageBuf.specmod().attribute(param.name().c_str(), param.type(), param.data());
+    }
+}
+
+ImageBuf
+letterbox_image(const ImageBuf& imageBuf, int width, int height)
+{
+    const ImageSpec& spec = imageBuf.spec();
+    ImageSpec copyspec(width, height, spec.nchannels, spec.format);
+    ImageBuf copybuf(copyspec);
+    ImageBufAlgo::zero(copybuf);
+
+    int xoffset = (width - spec.width) / 2;
+    int yoffset = (height - spec.height) / 2;
+
+    ImageBufAlgo::paste(copybuf, xoffset, yoffset, 0, 0, imageBuf);
+    copy_attributes(copybuf, spec);
+    return copybuf;
+}
+
+ImageBuf
+downsample_image(const ImageBuf& imageBuf, const std::string& filter)
+{
+    const ImageSpec& spec = imageBuf.spec();
+    int width = (spec.width + 1) / 2;
+    int height = (spec.height + 1) / 2;
+    int channels = spec.nchannels;
+    const float* src = static_cast<const float*>(imageBuf.localpixels());
+    if (filter != "box" || spec.format != TypeDesc::FLOAT || src == nullptr || spec.width < 2 || spec.height < 2) {
+        ImageBuf resizedbuf;
+        ImageBufAlgo::resize(resizedbuf, imageBuf, filter, 0, ROI(0, width, 0, height));
+        copy_attributes(resizedbuf, spec);
+        return resizedbuf;
+    }
+    // 2x2 box average straight from the local pixels, an odd last row and column repeat their edge pixels so
+    // the box averages only the pixels it covers
+    ImageBuf downsampledbuf(ImageSpec(width, height, channels, TypeDesc::FLOAT), InitializePixels::No);
+    float* dst = static_cast<float*>(downsampledbuf.localpixels());
+    size_t srcstride = static_cast<size_t>(spec.width) * channels;
+    size_t dststride = static_cast<size_t>(width) * channels;
+    parallel_for(0, height, [&](int64_t y) {
+        const float* row0 = src + static_cast<size_t>(2 * y) * srcstride;
+        const float* row1 = 2 * y + 1 < spec.height ? row0 + srcstride : row0;
+        float* out = dst + static_cast<size_t>(y) * dststride;
+        for (int x = 0; x < width; x++) {
+            const float* p0 = row0 + 2 * x * channels;
+            const float* p1 = row1 + 2 * x * channels;
+            int next = 2 * x + 1 < spec.width ? channels : 0;
+            for (int c = 0; c < channels; c++) {
+                out[x * channels + c] = 0.25f * (p0[c] + p0[c + next] + p1[c] + p1[c + next]);
+            }
+        }
+    });
+    copy_attributes(downsampledbuf, spec);
+    return downsampledbuf;
+}
+
+ImageBuf
+box_downsample(const ImageBuf& imageBuf, int factor, std::shared_ptr<float>& lease)
+{
+    // separable integer box, factor rows are summed in contiguous runs that vectorize and the summed row is
+    // reduced horizontally in a scalar pass, last boxes average only the rows and columns they cover
+    const ImageSpec& spec = imageBuf.spec();
+    int width = (spec.width + factor - 1) / factor;
+    int height = (spec.height + factor - 1) / factor;
+    int channels = spec.nchannels;
+    ImageSpec boxspec(width, height, channels, TypeDesc::FLOAT);
+    lease = bufferpool.acquire(boxspec.image_pixels() * channels);
+    ImageBuf boxbuf(boxspec, lease.get());
+    const float* src = static_cast<const float*>(imageBuf.localpixels());
+    float* dst = lease.get();
+    size_t srcstride = static_cast<size_t>(spec.width) * channels;
+    size_t dststride = static_cast<size_t>(width) * channels;
+    const int rows = 8;
+    int blocks = (height + rows - 1) / rows;
+    parallel_for(0, blocks, [&](int64_t block) {
+        std::vector<float> sums(srcstride);
+        int ybegin = static_cast<int>(block) * rows;
+        int yend = std::min(height, ybegin + rows);
+        for (int y = ybegin; y < yend; y++) {
+            std::fill(sums.begin(), sums.end(), 0.0f);
+            float* sum = sums.data();
+            int boxrows = std::min(factor, spec.height - y * factor);
+            for (int i = 0; i < boxrows; i++) {
+                const float* row = src + (static_cast<size_t>(y) * factor + i) * srcstride;
+                for (size_t x = 0; x < srcstride; x++) {
+                    sum[x] += row[x];
+                }
+            }
+            float* out = dst + static_cast<size_t>(y) * dststride;
+            for (int x = 0; x < width; x++) {
+                const float* p = sum + static_cast<size_t>(x) * factor * channels;
+                int boxcolumns = std::min(factor, spec.width - x * factor);
+                float scale = 1.0f / (boxrows * boxcolumns);
+                for (int c = 0; c < channels; c++) {
+                    float value = 0.0f;
+                    for (int i = 0; i < boxcolumns; i++) {
+                        value += p[i * channels + c];
+                    }
+                    out[x * channels + c] = value * scale;
+                }
+            }
+        }
+    });
+    copy_attributes(boxbuf, spec);
+    return boxbuf;
+}
+
+bool
+resize_image(ImageBuf& dst, const ImageBuf& src, const std::string& filter, ROI roi)
+{
+    if (roi.width() <= 0 || roi.height() <= 0) {
+        return false;
+    }
+    if (filter != "fast") {
+        return ImageBufAlgo::resize(dst, src, filter, 0, roi);
+    }
+    // integer box prefilter down to at least twice the output size, then a small triangle kernel, the filter
+    // footprint no longer grows with the reduction ratio
+    const ImageSpec& spec = src.spec();
+    int factor = std::min(spec.width / (2 * roi.width()), spec.height / (2 * roi.height()));
+    if (factor < 2 || spec.format != TypeDesc::FLOAT || src.localpixels() == nullptr) {
+        return ImageBufAlgo::resize(dst, src, "triangle", 0, roi);
+    }
+    std::shared_ptr<float> lease;
+    ImageBuf boxbuf = box_downsample(src, factor, lease);
+    return ImageBufAlgo::resize(dst, boxbuf, "triangle", 0, roi);
+}
+
+// utils - 3dlut
+bool
+read_sidecar_3dlut(const std::string& inputfilename, const std::string& outputdirectory, std::string& lutfile)
+{
+    std::string sidecarfile = combine_path(filename_path(inputfilename) + "/Proxy",
+                                           filename(extension(inputfilename, "sidecar")));
+
+    print_info("reading braw sidecardata from file: ", sidecarfile);
+
+    std::ifstream sidecar(sidecarfile);
+    if (!sidecar.is_open()) {
+        print_warning("could not find sidecar file: ", sidecarfile);
+        return false;
+    }
+    std::string line;
+    std::string name, title, data;
+    int lutSize = 0;
+    boost::regex multispaces("\\s{2,}");
+    boost::regex leadingspaces("^\\s+");
+    bool datarun = false;
+    while (getline(sidecar, line)) {
+        if (datarun) {
+            if (line.find("\"") != std::string::npos) {
+                std::string value = line.substr(0, line.rfind("\""));
+                value = boost::regex_replace(value, multispaces, " ");
+                value = boost::regex_replace(value, leadingspaces, "");
+                data += value;
+                break;
+            }
+            std::string value = boost::regex_replace(line, multispaces, " ");
+            value = boost::regex_replace(value, leadingspaces, "");
+            data += value + "\n";
+            continue;
+        }
+        if (line.find("\"post_3dlut_sidecar_name\":") != std::string::npos) {
+            boost::regex expr(R"("post_3dlut_sidecar_name"\s*:\s*"([^"]*)\")");
+            boost::smatch what;
+            if (boost::regex_search(line, what, expr)) {
+                name = what[1];
+            }
+        }
+        else if (line.find("\"post_3dlut_sidecar_title\":") != std::string::npos) {
+            boost::regex expr(R"("post_3dlut_sidecar_title"\s*:\s*"([^"]*)\")");
+            boost::smatch what;
+            if (boost::regex_search(line, what, expr)) {
+                title = what[1];
+            }
+        }
+        else if (line.find("\"post_3dlut_sidecar_size\":") != std::string::npos) {
+            boost::regex expr(R"("post_3dlut_sidecar_size"\s*:\s*(\d+))");
+            boost::smatch what;
+            if (boost::regex_search(line, what, expr)) {
+                lutSize = std::stoi(what[1]);
+            }
+        }
+        else if (line.find("\"post_3dlut_sidecar_data\":") != std::string::npos) {
+            datarun = true;
+            size_t startPos = line.find("\"", line.find(":")) + 1;
+            if (startPos != std::string::npos && startPos < line.size()) {
+                std::string value = line.substr(startPos);
+                if (!value.empty() && value.find("\"") != std::string::npos) {
+                    value = value.substr(0, value.find("\""));
+                }
+                value = boost::regex_replace(value, multispaces, " ");
+                value = boost::regex_replace(value, leadingspaces, "");
+                data += value + (value.empty() ? "" : "\n");
+            }
+        }
+    }
+    std::string lutdirectory = combine_path(outputdirectory, "/3DLut");
+
+    if (!exists(lutdirectory)) {
+        if (!create_path(lutdirectory)) {
+            print_error("could not create 3dlut directory: ", lutdirectory);
+            return false;
+        }
+    }
+
+    lutfile = combine_path(lutdirectory, name);
+
+    if (!exists(lutfile)) {
+        std::ofstream outputFile(lutfile);
+        if (outputFile) {
+            outputFile << "BMD_TITLE " << title << std::endl;
+            outputFile << std::endl;
+            outputFile << "LUT_3D_SIZE " << std::to_string(lutSize) << std::endl;
+            outputFile << data;
+            outputFile.close();
+        }
+        else {
+            print_error("could not open output lut file: ", lutfile);
+            return false;
+        }
+    }
+    return true;
+}
+
+ConstCPUProcessorRcPtr
+ocio_processor(const std::string& lutfile)
+{
+    ConstConfigRcPtr config = Config::CreateRaw();
+    FileTransformRcPtr transform = FileTransform::Create();
+    transform->setSrc(lutfile.c_str());
+    transform->setInterpolation(INTERP_BEST);
+
+    ConstProcessorRcPtr processor = config->getProcessor(transform);
+    return processor->getDefaultCPUProcessor();
+}
+
+void
+apply_builtin_3dlut(const Braw3DLut& lut, Braw3DLutIsa isa, float* pixels, int width, int height, int channels)
+{
+    parallel_for(0, height, [&](int64_t y) {
+        lut.apply(pixels + static_cast<size_t>(y) * width * channels, width, channels, isa);
+    });
+}
+
+float
+compare_3dlut(const Braw3DLut& lut, Braw3DLutIsa isa, const ConstCPUProcessorRcPtr& processor)
+{
+    // lattice points, points in between and points slightly outside of the domain
+    const int steps = 37;
+    std::vector<float> pixels;
+    pixels.reserve(3 * steps * steps * steps);
+    for (int b = 0; b < steps; b++) {
+        for (int g = 0; g < steps; g++) {
+            for (int r = 0; r < steps; r++) {
+                pixels.push_back(-0.05f + 1.1f * r / (steps - 1));
+                pixels.push_back(-0.05f + 1.1f * g / (steps - 1));
+                pixels.push_back(-0.05f + 1.1f * b / (steps - 1));
+            }
+        }
+    }
+    std::vector<float> expected = pixels;
+    PackedImageDesc imgDesc(&expected[0], steps * steps * steps, 1, 3);
+    processor->apply(imgDesc);
+    lut.apply(&pixels[0], steps * steps * steps, 3, isa);
+    float maxdiff = 0.0f;
+    for (size_t i = 0; i < pixels.size(); i++) {
+        maxdiff = std::max(maxdiff, std::abs(pixels[i] - expected[i]));
+    }
+    return maxdiff;
+}
+
+// braw 3dlut processor
+struct Braw3DLutProcessor {
+    ConstCPUProcessorRcPtr processor;
+    std::shared_ptr<Braw3DLut> lut;  // only set when equivalent to the ocio result
+    Braw3DLutIsa isa = Braw3DLutIsa::Scalar;
+};
+
+std::shared_ptr<Braw3DLutProcessor>
+lut3d_processor(const std::string& lutfile)
+{
+    static std::mutex mutex;
+    static std::map<std::string, std::shared_ptr<Braw3DLutProcessor>> processors;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (processors.count(lutfile)) {
+        return processors[lutfile];
+    }
+    std::shared_ptr<Braw3DLutProcessor> lutprocessor = std::make_shared<Braw3DLutProcessor>();
+    lutprocessor->processor = ocio_processor(lutfile);
+    if (tool.lutengine != "ocio") {
+        std::shared_ptr<Braw3DLut> lut = std::make_shared<Braw3DLut>();
+        if (lut->read(lutfile)) {
+            Braw3DLutIsa isa = lut3d_isas().back();
+            float maxdiff = compare_3dlut(*lut, isa, lutprocessor->processor);
+            if (maxdiff <= 1e-4f) {
+                lutprocessor->lut = lut;
+                lutprocessor->isa = isa;
+                print_info("using builtin 3dlut with " + lut3d_isa_str(isa) + " for size: ", lut->size());
+            }
+            else {
+                print_warning("builtin 3dlut differs from ocio, using ocio for: ", lutfile);
+            }
+        }
+    }
+    processors[lutfile] = lutprocessor;
+    return lutprocessor;
+}
+
+bool
+apply_3dlut(ImageBuf& imageBuf, const std::string& lutfile)
+{
+    std::shared_ptr<Braw3DLutProcessor> lutprocessor = lut3d_processor(lutfile);
+    const ImageSpec& spec = imageBuf.spec();
+    float* localpixels = static_cast<float*>(imageBuf.localpixels());
+    if (lutprocessor->lut && localpixels && spec.format == TypeDesc::FLOAT && spec.nchannels >= 3) {
+        apply_builtin_3dlut(*lutprocessor->lut, lutprocessor->isa, localpixels, spec.width, spec.height,
+                            spec.nchannels);
+        return true;
+    }
+    {
+        int xres = spec.width;
+        int yres = spec.height;
+        int channels = spec.nchannels;
+        ROI roi = ROI(0, xres, 0, yres, 0, 1, 0, channels);
+        std::shared_ptr<float> pixels = bufferpool.acquire(roi.npixels() * roi.nchannels());
+
+        if (!imageBuf.get_pixels(roi, TypeDesc::FLOAT, pixels.get())) {
+            return false;
+        }
+        PackedImageDesc imgDesc(pixels.get(), roi.width(), roi.height(), roi.nchannels());
+
+        // apply color transformation
+        lutprocessor->processor->apply(imgDesc);
+        imageBuf.set_pixels(roi, TypeDesc::FLOAT, pixels.get());
+    }
+    return true;
+}
+
+// utils - benchmark
+int
+run_benchmark()
+{
+    std::map<std::string, BrawColorspace> colorspaces;
+    if (!read_colorspaces(resources_path("brawtool.json"), colorspaces)) {
+        print_error("could not open colorspaces file: ", resources_path("brawtool.json"));
+        return EXIT_FAILURE;
+    }
+    const int width = 7680;
+    const int height = 4320;
+    const int channels = 3;
+    print_info("running benchmark on frame: ", str_by_int(width) + "x" + str_by_int(height));
+    std::vector<float> source(static_cast<size_t>(width) * height * channels);
+    parallel_for(0, height, [&](int64_t y) {
+        uint32_t seed = static_cast<uint32_t>(y) * 2654435761u;
+        float* row = &source[static_cast<size_t>(y) * width * channels];
+        for (int x = 0; x < width * channels; x++) {
+            seed = seed * 1664525u + 1013904223u;
+            row[x] = -0.05f + 1.1f * (seed >> 8) / static_cast<float>(1 << 24);
+        }
+    });
+    {
+        // frames copied out of the decoder, fresh buffers page fault on first touch, pooled ones are mapped
+        const int frames = 4;
+        const size_t count = source.size();
+        const size_t stride = static_cast<size_t>(width) * channels;
+        Timer timer;
+        for (int i = 0; i < frames; i++) {
+            std::unique_ptr<float[]> pixels(new float[count]);
+            copy_pixels(pixels.get(), &source[0], width, height, channels, stride, nullptr);
+        }
+        print_info("frame buffers fresh: ", std::to_string(timer() / frames) + "s per frame");
+        timer.reset();
+        timer.start();
+        for (int i = 0; i < frames; i++) {
+            std::shared_ptr<float> pixels = bufferpool.acquire(count);
+            copy_pixels(pixels.get(), &source[0], width, height, channels, stride, nullptr);
+        }
+        print_info("frame buffers pooled: ", std::to_string(timer() / frames) + "s per frame, " + bufferpool.str());
+    }
+    {
+        // thumbnail resize, quality compared to lanczos3 as reference
+        ImageBuf sourcebuf(ImageSpec(width, height, channels, TypeDesc::FLOAT), &source[0]);
+        ROI roi(0, 854, 0, 480);
+        ImageBuf referencebuf;
+        ImageBufAlgo::resize(referencebuf, sourcebuf, "lanczos3", 0, roi);
+        for (const std::string filter : { "triangle", "box", "gaussian", "lanczos3", "fast" }) {
+            Timer timer;
+            ImageBuf resizedbuf;
+            resize_image(resizedbuf, sourcebuf, filter, roi);
+            double time = timer();
+            ImageBufAlgo::CompareResults results = ImageBufAlgo::compare(resizedbuf, referencebuf, 1.0f, 1.0f);
+            print_info("resize 854x480 " + filter + ": ",
+                       std::to_string(time) + "s, rms difference to lanczos3: " + std::to_string(results.rms_error));
+        }
+    }
+    for (const std::pair<const std::string, BrawColorspace>& colorspace : colorspaces) {
+        const std::string& lutfile = colorspace.second.filename;
+        std::vector<float> expected = source;
+        ConstCPUProcessorRcPtr processor = ocio_processor(lutfile);
+        Timer timer;
+        PackedImageDesc imgDesc(&expected[0], width, height, channels);
+        processor->apply(imgDesc);
+        print_info("3dlut " + colorspace.first + " ocio: ", std::to_string(timer()) + "s");
+
+        Braw3DLut lut;
+        if (!lut.read(lutfile)) {
+            print_warning("could not read builtin 3dlut: ", lutfile);
+            continue;
+        }
+        for (Braw3DLutIsa isa : lut3d_isas()) {
+            std::vector<float> pixels = source;
+            timer.reset();
+            timer.start();
+            apply_builtin_3dlut(lut, isa, &pixels[0], width, height, channels);
+            double time = timer();
+            float maxdiff = 0.0f;
+            for (size_t i = 0; i < pixels.size(); i++) {
+                maxdiff = std::max(maxdiff, std::abs(pixels[i] - expected[i]));
+            }
+            print_info("3dlut " + colorspace.first + " builtin " + lut3d_isa_str(isa) + ": ",
+                       std::to_string(time) + "s, max difference: " + std::to_string(maxdiff));
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+// utils - metadata
+void
+apply_metadata(ImageBuf& imageBuf, const BrawVariant& variant, const std::string& inputfilename)
+{
+    boost::optional<int> kelvin = variant.kelvin ? variant.kelvin : tool.kelvin;
+    boost::optional<int> tint = variant.tint ? variant.tint : tool.tint;
+    boost::optional<float> exposure = variant.exposure ? variant.exposure : tool.exposure;
+    std::vector<BrawMetadata> metadatas = {
+        BrawMetadata() = { "filename", "filename", TypeDesc::STRING, 0, 0 },
+        BrawMetadata() = { "exposure", "exposure", TypeDesc::STRING, 0, 0 },
+        BrawMetadata() = { "sensor_rate", "fps", TypeDesc::STRING, 0, 0 },
+        BrawMetadata() = { "shutter_value", "shutter", TypeDesc::STRING, 0, 0 },
+        BrawMetadata() = { "aperture", "iris", TypeDesc::STRING, 0, 0 },
+        BrawMetadata() = { "iso", "iso", TypeDesc::INT, 0, 0 },
+        BrawMetadata() = { "white_balance_kelvin", "wb", TypeDesc::INT, 0, 0 },
+        BrawMetadata() = { "white_balance_tint", "tint", TypeDesc::INT, 0, 0 },
+        BrawMetadata() = { "lens_type", "lens", TypeDesc::STRING, 0, 0 },
+        BrawMetadata() = { "focal_length", "focal length", TypeDesc::STRING, 0, 0 },
+        BrawMetadata() = { "distance", "focus", TypeDesc::STRING, 0, 0 },
+        BrawMetadata() = { "date_recorded", "date", TypeDesc::STRING, 0, 0 },
+    };
+    int width = imageBuf.spec().width;
+    int height = imageBuf.spec().height;
+    int x = width * 0.02;
+    int y = height * 0.04f;
+    for (BrawMetadata metadata : metadatas) {
+        const ImageSpec& spec = imageBuf.spec();
+        if (metadata.key == "filename") {
+            metadata.name = filename(inputfilename);
+        }
+        else {
+            const ParamValue* attr = spec.find_attribute(metadata.key);
+            if (attr) {
+                std::string value;
+                const TypeDesc type = attr->type();
+                switch (type.basetype) {
+                case TypeDesc::STRING: value = *(const char**)attr->data(); break;
+                case TypeDesc::FLOAT: value = str_by_float(*(const float*)attr->data()); break;
+                case TypeDesc::INT8: value = std::to_string(*(const char*)attr->data()); break;
+                case TypeDesc::UINT8: value = std::to_string(*(const unsigned char*)attr->data()); break;
+                case TypeDesc::INT16: value = std::to_string(*(const short*)attr->data()); break;
+                case TypeDesc::UINT16: value = std::to_string(*(const unsigned short*)attr->data()); break;
+                case TypeDesc::INT: value = std::to_string(*(const int*)attr->data()); break;
+                case TypeDesc::UINT: value = std::to_string(*(const unsigned int*)attr->data()); break;
+                }
+                if (metadata.key == "exposure") {
+                    if (exposure.has_value()) {
+                        metadata.name = metadata.name + ": " + str_by_float(exposure.value()) + " (" + value + ")";
+                    }
+                    else {
+                        metadata.name = metadata.name + ": " + value;
+                    }
+                }
+                else if (metadata.key == "white_balance_kelvin") {
+                    if (kelvin.has_value()) {
+                        metadata.name = metadata.name + ": " + std::to_string(kelvin.value()) + " (" + value + ")";
+                    }
+                    else {
+                        metadata.name = metadata.name + ": " + value;
+                    }
+                }
+                else if (metadata.key == "white_balance_tint") {
+                    if (tint.has_value()) {
+                        metadata.name = metadata.name + ": " + std::to_string(tint.value()) + " (" + value + ")";
+                    }
+                    else {
+                        metadata.name = metadata.name + ": " + value;
+                    }
+                }
+                else {
+                    metadata.name = metadata.name + ": " + value;
+                }
+            }
+        }
+        metadata.x = x;
+        metadata.y = y;
+        y += draw_metadata(imageBuf, metadata).height() + height * 0.01f;
+    }
+}
+
+// utils - variants
+std::string
+variant_filename(const std::string& inputfilename, const std::string& outputdirectory, const BrawVariant& variant,
+                 int level = 0)
+{
+    std::string suffix = variant.name.size() ? "_" + variant.name : "";
+    if (level > 0) {
+        suffix += "_p" + str_by_int(level);
+    }
+    return combine_path(outputdirectory, filename(extension(inputfilename, suffix + "." + variant.outputformat)));
+}
+
+std::string
+finish_variant(ImageBuf& imageBuf, const BrawVariant& variant, const std::string& lutfile,
+               const std::string& inputfilename, const std::string& outputfilename)
+{
+    if (lutfile.size()) {
+        if (!apply_3dlut(imageBuf, lutfile)) {
+            return "failed to get pixel data from the image buffer";
+        }
+    }
+    if (variant.applymetadata) {
+        apply_metadata(imageBuf, variant, inputfilename);
+    }
+    if (!write_image(imageBuf, outputfilename, variant.outputformat, variant.outputdatatype)) {
+        return "could not write file: " + imageBuf.geterror();
+    }
+    return std::string();
+}
+
+std::string
+render_variant(ImageBuf& imageBuf, const BrawVariant& variant, int width, int height, const std::string& lutfile,
+               const std::string& inputfilename, const std::string& outputdirectory)
+{
+    if (imageBuf.spec().width != width || imageBuf.spec().height != height) {
+        imageBuf = letterbox_image(imageBuf, width, height);
+    }
+    if (!tool.pyramid) {
+        return finish_variant(imageBuf, variant, lutfile, inputfilename,
+                              variant_filename(inputfilename, outputdirectory, variant));
+    }
+    // pyramid levels are downsampled from the previous level before lut and metadata are applied
+    ImageBuf levelbuf;
+    levelbuf.copy(imageBuf);  // deep copy, luts are applied in place
+    std::string error = finish_variant(imageBuf, variant, lutfile, inputfilename,
+                                       variant_filename(inputfilename, outputdirectory, variant));
+    for (int level = 1; level <= tool.pyramid && !error.size(); level++) {
+        if (levelbuf.spec().width < 2 || levelbuf.spec().height < 2) {
+            break;
+        }
+        Timer timer;
+        levelbuf = downsample_image(levelbuf, tool.pyramidfilter);
+        double downsampletime = timer.lap();
+        ImageBuf outputbuf = levelbuf;
+        std::string outputfilename = variant_filename(inputfilename, outputdirectory, variant, level);
+        error = finish_variant(outputbuf, variant, lutfile, inputfilename, outputfilename);
+        double finishtime = timer.lap();
+        print_info("pyramid level " + str_by_int(level) + " " + str_by_int(levelbuf.spec().width) + "x"
+                       + str_by_int(levelbuf.spec().height) + " downsample: " + std::to_string(downsampletime)
+                       + "s, lut, metadata and write: ",
+                   std::to_string(finishtime) + "s, file: " + outputfilename);
+    }
+    return error;
+}
+
+// utils - wedges
+std::string
+render_wedges(std::vector<ImageBuf>& wedgebufs, const std::vector<BrawWedge>& wedges, const BrawVariant& variant,
+              const std::string& lutfile, const std::string& inputfilename, const std::string& outputdirectory)
+{
+    for (size_t i = 0; i < wedgebufs.size(); i++) {
+        BrawVariant wedgevariant = variant;
+        wedgevariant.name = variant.name + "_" + wedges[i].name;
+        wedgevariant.kelvin = wedges[i].kelvin;
+        wedgevariant.tint = wedges[i].tint;
+        wedgevariant.exposure = wedges[i].exposure;
+        const ImageSpec spec = wedgebufs[i].spec();
+        int width, height, resizewidth, resizeheight;
+        fit_size(spec.width, spec.height, variant, width, height, resizewidth, resizeheight);
+        if (resizewidth != spec.width || resizeheight != spec.height) {
+            ImageBuf resizebuf;
+            resize_image(resizebuf, wedgebufs[i], tool.resizefilter, ROI(0, resizewidth, 0, resizeheight));
+            copy_attributes(resizebuf, spec);
+            wedgebufs[i] = std::move(resizebuf);
+        }
+        print_info("writing wedge file: ", variant_filename(inputfilename, outputdirectory, wedgevariant));
+        std::string error = render_variant(wedgebufs[i], wedgevariant, width, height, lutfile, inputfilename,
+                                           outputdirectory);
+        if (error.size()) {
+            return error;
+        }
+        wedgebufs[i].clear();
+    }
+    return std::string();
+}
+
+std::string
+render_wedge_grid(std::vector<ImageBuf>& wedgebufs, const std::vector<BrawWedge>& wedges,
+                  const BrawVariant& variant, const std::string& lutfile, const std::string& inputfilename,
+                  const std::string& outputdirectory)
+{
+    // the grid fits the output size, cells keep the frame aspect ratio in rows of equal columns
+    const ImageSpec spec = wedgebufs[0].spec();
+    int width, height, resizewidth, resizeheight;
+    fit_size(spec.width, spec.height, variant, width, height, resizewidth, resizeheight);
+    int count = static_cast<int>(wedgebufs.size());
+    int columns = static_cast<int>(std::ceil(std::sqrt(static_cast<float>(count))));
+    int rows = (count + columns - 1) / columns;
+    int cellwidth = std::max(1, resizewidth / columns);
+    int cellheight = std::max(1, resizeheight / columns);
+
+    ImageBuf gridbuf(ImageSpec(cellwidth * columns, cellheight * rows, spec.nchannels, spec.format));
+    ImageBufAlgo::zero(gridbuf);
+    for (int i = 0; i < count; i++) {
+        ImageBuf cellbuf;
+        resize_image(cellbuf, wedgebufs[i], tool.resizefilter, ROI(0, cellwidth, 0, cellheight));
+        ImageBufAlgo::paste(gridbuf, (i % columns) * cellwidth, (i / columns) * cellheight, 0, 0, cellbuf);
+        wedgebufs[i].clear();
+    }
+    copy_attributes(gridbuf, spec);
+    if (lutfile.size()) {
+        if (!apply_3dlut(gridbuf, lutfile)) {
+            return "failed to get pixel data from the image buffer";
+        }
+    }
+    // labels are drawn after the 3dlut to stay legible
+    for (int i = 0; i < count; i++) {
+        BrawMetadata label = { "wedge", wedges[i].label, TypeDesc::STRING, 0, 0 };
+        label.x = (i % columns) * cellwidth + static_cast<int>(gridbuf.spec().width * 0.01f);
+        label.y = (i / columns) * cellheight + static_cast<int>(gridbuf.spec().height * 0.04f);
+        draw_metadata(gridbuf, label);
+    }
+    std::string outputfilename = variant_filename(inputfilename, outputdirectory, variant);
+    print_info("writing wedge grid file: ", outputfilename);
+    if (!write_image(gridbuf, outputfilename, variant.outputformat, variant.outputdatatype)) {
+        return "could not write file: " + gridbuf.geterror();
+    }
+    return std::string();
+}
+
+// braw stream
+static std::string
+y4m_framerate(float framerate)
+{
+    // ntsc rates as exact 1001 fractions, 23.976 as 24000:1001
+    float ntsc = framerate * 1.001f;
+    if (std::abs(ntsc - std::round(ntsc)) < 0.01f && std::abs(framerate - std::round(framerate)) > 0.01f) {
+        return str_by_int(static_cast<int>(std::round(ntsc)) * 1000) + ":1001";
+    }
+    return str_by_int(static_cast<int>(std::round(framerate * 1000))) + ":1000";
+}
+
+bool
+write_stream_frame(const ImageBuf& imageBuf, const std::string& format, float framerate, bool header,
+                   std::vector<float>& pixels, std::vector<unsigned char>& buffer, FILE* stream)
+{
+    const ImageSpec& spec = imageBuf.spec();
+    ROI roi(0, spec.width, 0, spec.height, 0, 1, 0, 3);
+    size_t count = static_cast<size_t>(spec.width) * spec.height;
+    if (format == "rgb24") {
+        buffer.resize(count * 3);
+        if (!imageBuf.get_pixels(roi, TypeDesc::UINT8, buffer.data())) {
+            return false;
+        }
+    }
+    else if (format == "rgb48") {
+        buffer.resize(count * 3 * sizeof(uint16_t));  // native endian, rgb48le on supported platforms
+        if (!imageBuf.get_pixels(roi, TypeDesc::UINT16, buffer.data())) {
+            return false;
+        }
+    }
+    else {
+        // y4m 4:4:4 planes in bt.709 video range
+        pixels.resize(count * 3);
+        buffer.resize(count * 3);
+        if (!imageBuf.get_pixels(roi, TypeDesc::FLOAT, pixels.data())) {
+            return false;
+        }
+        unsigned char* y = buffer.data();
+        unsigned char* cb = y + count;
+        unsigned char* cr = cb + count;
+        parallel_for(0, spec.height, [&](int64_t row) {
+            for (int64_t i = row * spec.width; i < (row + 1) * spec.width; i++) {
+                float r = std::max(0.0f, std::min(pixels[i * 3 + 0], 1.0f));
+                float g = std::max(0.0f, std::min(pixels[i * 3 + 1], 1.0f));
+                float b = std::max(0.0f, std::min(pixels[i * 3 + 2], 1.0f));
+                float luma = 0.2126f * r + 0.7152f * g + 0.0722f * b;
+                y[i] = static_cast<unsigned char>(16.0f + 219.0f * luma + 0.5f);
+                cb[i] = static_cast<unsigned char>(128.0f + 224.0f * (b - luma) / 1.8556f + 0.5f);
+                cr[i] = static_cast<unsigned char>(128.0f + 224.0f * (r - luma) / 1.5748f + 0.5f);
+            }
+        });
+        if (header) {
+            std::string y4mheader = "YUV4MPEG2 W" + str_by_int(spec.width) + " H" + str_by_int(spec.height) + " F"
+                                    + y4m_framerate(framerate) + " Ip A1:1 C444\n";
+            if (fwrite(y4mheader.data(), 1, y4mheader.size(), stream) != y4mheader.size()) {
+                return false;
+            }
+        }
+        if (fwrite("FRAME\n", 1, 6, stream) != 6) {
+            return false;
+        }
+    }
+    return fwrite(buffer.data(), 1, buffer.size(), stream) == buffer.size();
+}
+
+std::string
+stream_range(int64_t framecount, int64_t& start, int64_t& end)
+{
+    start = tool.framestart >= 0 ? tool.framestart : 0;
+    end = tool.frameend >= 0 ? tool.frameend : framecount - 1;
+    if (end < start || end >= framecount) {
+        return "stream range is outside of clip frames: 0-" + std::to_string(framecount - 1);
+    }
+    return std::string();
+}
+
+std::string
+stream_frame(ImageBuf& imageBuf, const BrawVariant& variant, const std::string& lutfile, float framerate,
+             int64_t frame, bool header, std::vector<float>& pixels, std::vector<unsigned char>& buffer, FILE* stream)
+{
+    int width, height, resizewidth, resizeheight;
+    fit_size(imageBuf.spec().width, imageBuf.spec().height, variant, width, height, resizewidth, resizeheight);
+    if (resizewidth != imageBuf.spec().width || resizeheight != imageBuf.spec().height) {
+        ImageBuf resizedbuf;
+        resize_image(resizedbuf, imageBuf, tool.resizefilter, ROI(0, resizewidth, 0, resizeheight));
+        imageBuf = std::move(resizedbuf);
+    }
+    if (width != resizewidth || height != resizeheight) {
+        imageBuf = letterbox_image(imageBuf, width, height);
+    }
+    if (lutfile.size() && !apply_3dlut(imageBuf, lutfile)) {
+        return "failed to get pixel data from the image buffer";
+    }
+    if (!write_stream_frame(imageBuf, tool.streamformat, framerate, header, pixels, buffer, stream)) {
+        return "could not write frame to stream: " + std::to_string(frame);
+    }
+    metrics.count("brawtool_frames_processed_total");
+    if (tool.verbose) {
+        print_info("streamed frame: ", frame);
+    }
+    return std::string();
+}
+
+void
+print_stream_rate(int64_t start, int64_t end, double seconds)
+{
+    print_info("streamed frames " + std::to_string(start) + "-" + std::to_string(end) + ": ",
+               std::to_string((end - start + 1) / std::max(seconds, 1e-6)) + " fps");
+}
+
+// braw session
+struct BrawSession {
+    std::map<std::string, BrawColorspace> colorspaces;
+    std::vector<BrawVariant> variants;
+    BrawVariant wedgevariant;
+    BrawVariant streamvariant;
+    BrawVariant thumbnailvariant;
+#if defined(BlackmagicRaw_FOUND)
+    IBlackmagicRawFactory* factory = nullptr;
+    IBlackmagicRaw* codec = nullptr;  // created on first decode and kept warm between clips
+
+    bool create_codec()
+    {
+        if (factory == nullptr) {
+            factory = CreateBlackmagicRawFactoryInstanceFromPath(CFSTR(BlackmagicRaw_LIBRARY_PATH));
+            if (factory == nullptr) {
+                print_error("could not initialize blackmagic factory from path: ", BlackmagicRaw_LIBRARY_PATH);
+                return false;
+            }
+        }
+        if (codec == nullptr && factory->CreateCodec(&codec) != S_OK) {
+            print_error("could not create codec from blackmagic api");
+            return false;
+        }
+        return true;
+    }
+
+    ~BrawSession()
+    {
+        if (codec != nullptr) {
+            codec->Release();
+        }
+        if (factory != nullptr) {
+            factory->Release();
+        }
+    }
+#endif
+};
+
+bool
+read_3dlut(BrawSession& session, const std::string& lut, const std::string& inputfilename, std::string& lutfile)
+{
+    if (lut == "sidecar") {
+        return read_sidecar_3dlut(inputfilename, tool.outputdirectory, lutfile);
+    }
+    lutfile = session.colorspaces[lut].filename;
+    return true;
+}
+
+// braw frame source
+class BrawFrameSource {
+public:
+    virtual ~BrawFrameSource() = default;
+    virtual bool open(const std::string& inputfilename) = 0;
+    virtual bool read(int64_t frame, ImageBuf& imageBuf, std::vector<std::shared_ptr<float>>& leases) = 0;
+    virtual void read_metadata(int64_t frame, ImageBuf& imageBuf) = 0;  // clip and frame metadata, no decode
+    virtual int width() const = 0;
+    virtual int height() const = 0;
+    virtual int64_t frames() const = 0;
+    virtual float framerate() const = 0;
+
+    void set_scale(int scale) { m_scale = scale; }
+    void set_crop(const ROI& crop) { m_crop = crop; }
+    void set_stats(BrawStats* stats) { m_stats = stats; }
+
+protected:
+    int m_scale = 1;
+    boost::optional<ROI> m_crop;
+    BrawStats* m_stats = nullptr;
+};
+
+#if defined(BlackmagicRaw_FOUND)
+class BrawDecodeSource : public BrawFrameSource {
+public:
+    explicit BrawDecodeSource(BrawSession& session)
+        : m_session(session)
+    {}
+    ~BrawDecodeSource() override
+    {
+        if (m_clip != nullptr) {
+            m_clip->Release();
+        }
+    }
+
+    bool open(const std::string& inputfilename) override
+    {
+        if (!m_session.create_codec()) {
+            return false;
+        }
+        CFStringRef clipfilename = cfstr_by_str(inputfilename);
+        HRESULT result = m_session.codec->OpenClip(clipfilename, &m_clip);
+        CFRelease(clipfilename);
+        if (result != S_OK) {
+            print_error("could not open input filename: ", inputfilename);
+            return false;
+        }
+        return true;
+    }
+
+    bool read(int64_t frame, ImageBuf& imageBuf, std::vector<std::shared_ptr<float>>& leases) override
+    {
+        BrawCallback* callback = new BrawCallback();
+        callback->AddRef();
+        BrawCallbackRef callbackref(callback, BrawCallbackRelease { m_session.codec });
+        configure_callback(callback, m_stats, m_crop);
+        if (m_scale > 1) {
+            callback->SetResolutionScale(m_scale >= 8   ? blackmagicRawResolutionScaleEighth
+                                         : m_scale >= 4 ? blackmagicRawResolutionScaleQuarter
+                                                        : blackmagicRawResolutionScaleHalf);
+        }
+        HRESULT result = m_session.codec->SetCallback(callback);
+        IBlackmagicRawJob* job = nullptr;
+        if (result == S_OK) {
+            result = m_clip->CreateJobReadFrame(frame, &job);
+        }
+        if (result == S_OK) {
+            result = job->Submit();
+            if (result != S_OK) {
+                job->Release();
+            }
+        }
+        if (result == S_OK) {
+            m_session.codec->FlushJobs();
+        }
+        bool decoded = result == S_OK && callback->GetFrame() != nullptr;
+        if (decoded) {
+            IBlackmagicRawMetadataIterator* metadataIterator = nullptr;
+            if (m_clip->GetMetadataIterator(&metadataIterator) == S_OK) {
+                callback->ProcessMetaData(metadataIterator);
+                metadataIterator->Release();
+            }
+            if (callback->GetFrame()->GetMetadataIterator(&metadataIterator) == S_OK) {
+                callback->ProcessMetaData(metadataIterator);
+                metadataIterator->Release();
+            }
+        }
+        imageBuf = callback->GetImageBuf();  // shares the pooled pixels
+        std::vector<std::shared_ptr<float>> frameleases = callback->TakeLeases();
+        leases.insert(leases.end(), frameleases.begin(), frameleases.end());
+        return decoded && imageBuf.initialized();
+    }
+
+    void read_metadata(int64_t frame, ImageBuf& imageBuf) override
+    {
+        // the frame is read for its per frame camera metadata without submitting a decode
+        BrawCallback* callback = new BrawCallback();
+        callback->AddRef();
+        BrawCallbackRef callbackref(callback, BrawCallbackRelease { m_session.codec });
+        callback->SetImageBuf(imageBuf);
+        callback->SetReadOnly(true);
+        IBlackmagicRawMetadataIterator* metadataIterator = nullptr;
+        if (m_clip->GetMetadataIterator(&metadataIterator) == S_OK) {
+            callback->ProcessMetaData(metadataIterator);
+            metadataIterator->Release();
+        }
+        IBlackmagicRawJob* job = nullptr;
+        HRESULT result = m_session.codec->SetCallback(callback);
+        if (result == S_OK) {
+            result = m_clip->CreateJobReadFrame(frame, &job);
+        }
+        if (result == S_OK) {
+            result = job->Submit();
+            if (result != S_OK) {
+                job->Release();
+            }
+        }
+        if (result == S_OK) {
+            m_session.codec->FlushJobs();
+        }
+        if (callback->GetFrame() != nullptr && callback->GetFrame()->GetMetadataIterator(&metadataIterator) == S_OK) {
+            callback->ProcessMetaData(metadataIterator);
+            metadataIterator->Release();
+        }
+        imageBuf = callback->GetImageBuf();
+    }
+
+    int width() const override
+    {
+        uint32_t width = 0;
+        m_clip->GetWidth(&width);
+        return static_cast<int>(width);
+    }
+
+    int height() const override
+    {
+        uint32_t height = 0;
+        m_clip->GetHeight(&height);
+        return static_cast<int>(height);
+    }
+
+    int64_t frames() const override
+    {
+        uint64_t framecount = 0;
+        m_clip->GetFrameCount(&framecount);
+        return static_cast<int64_t>(framecount);
+    }
+
+    float framerate() const override
+    {
+        float framerate = 0;
+        m_clip->GetFrameRate(&framerate);
+        return framerate;
+    }
+
+    IBlackmagicRawClip* clip() const { return m_clip; }  // for trim, wedges, audio and streaming
+
+private:
+    BrawSession& m_session;
+    IBlackmagicRawClip* m_clip = nullptr;
+};
+#endif
+
+class BrawSyntheticSource : public BrawFrameSource {
+public:
+    BrawSyntheticSource(int width, int height, int64_t frames)
+        : m_width(width)
+        , m_height(height)
+        , m_frames(frames)
+    {}
+
+    bool open(const std::string& inputfilename) override
+    {
+        print_info("synthesizing " + str_by_int(m_width) + "x" + str_by_int(m_height) + " frames for: ", inputfilename);
+        return true;
+    }
+
+    bool read(int64_t frame, ImageBuf& imageBuf, std::vector<std::shared_ptr<float>>& leases) override
+    {
+        if (frame < 0 || frame >= m_frames) {
+            return false;
+        }
+        // deterministic log like ramps and grain that move with the frame, rendered into a frame sized
+        // resource and copied out like a decoded sdk resource
+        const int channels = 3;
+        int width = std::max(1, m_width / m_scale);
+        int height = std::max(1, m_height / m_scale);
+        size_t stride = static_cast<size_t>(width) * channels;
+        std::shared_ptr<float> resource = bufferpool.acquire(stride * height);
+        float phase = static_cast<float>(frame % 240) / 240.0f;
+        parallel_for(0, height, [&](int64_t y) {
+            float* row = resource.get() + static_cast<size_t>(y) * stride;
+            uint32_t seed = static_cast<uint32_t>(frame * height + y) * 2654435761u;
+            float v = static_cast<float>(y) / height;
+            for (int x = 0; x < width; x++) {
+                float u = static_cast<float>(x) / width;
+                seed = seed * 1664525u + 1013904223u;
+                float grain = 0.02f * ((seed >> 8) / static_cast<float>(1 << 24) - 0.5f);
+                float ramp = u + phase;
+                row[x * channels + 0] = 0.1f + 0.8f * (ramp - std::floor(ramp)) + grain;
+                row[x * channels + 1] = 0.1f + 0.8f * v + grain;
+                row[x * channels + 2] = 0.5f + 0.4f * std::sin(6.2831853f * (u + v + phase)) + grain;
+            }
+        });
+        ROI roi(0, width, 0, height);
+        if (m_crop.has_value()) {
+            roi = roi_intersection(m_crop.value(), roi);
+        }
+        imageBuf = pooled_image(ImageSpec(roi.width(), roi.height(), channels, TypeDesc::FLOAT), leases);
+        const float* pixels = resource.get() + static_cast<size_t>(roi.ybegin) * stride
+                              + static_cast<size_t>(roi.xbegin) * channels;
+        copy_pixels(static_cast<float*>(imageBuf.localpixels()), pixels, roi.width(), roi.height(), channels, stride,
+                    m_stats);
+        read_metadata(frame, imageBuf);
+        return true;
+    }
+
+    void read_metadata(int64_t /*frame*/, ImageBuf& imageBuf) override
+    {
+        ImageSpec& spec = imageBuf.specmod();
+        spec.attribute("camera_type", "Synthetic");
+        spec.attribute("sensor_rate", framerate());
+        spec.attribute("shutter_value", "180°");
+        spec.attribute("aperture", "f4");
+        spec.attribute("iso", 800);
+        spec.attribute("white_balance_kelvin", 5600);
+        spec.attribute("white_balance_tint", 0);
+        spec.attribute("lens_type", "Synthetic 35mm");
+        spec.attribute("focal_length", "35mm");
+        spec.attribute("distance", "3000mm");
+        spec.attribute("date_recorded", "2024:01:01");
+    }
+
+    int width() const override { return m_width; }
+    int height() const override { return m_height; }
+    int64_t frames() const override { return m_frames; }
+    float framerate() const override { return 24.0f; }
+
+private:
+    int m_width;
+    int m_height;
+    int64_t m_frames;
+};
+
+std::unique_ptr<BrawFrameSource>
+frame_source(BrawSession& session)
+{
+#if defined(BlackmagicRaw_FOUND)
+    if (tool.syntheticwidth <= 0) {
+        return std::unique_ptr<BrawFrameSource>(new BrawDecodeSource(session));
+    }
+#else
+    (void)session;  // only the decoder needs the session
+#endif
+    return std::unique_ptr<BrawFrameSource>(
+        new BrawSyntheticSource(tool.syntheticwidth, tool.syntheticheight, tool.syntheticframes));
+}
+
+// braw stream frames
+#if defined(BlackmagicRaw_FOUND)
+std::string
+stream_frames(IBlackmagicRaw* codec, IBlackmagicRawClip* clip, BrawCallback* callback, const BrawVariant& variant,
+              const std::string& lutfile, FILE* stream)
+{
+    uint64_t framecount = 0;
+    float framerate = 0;
+    clip->GetFrameCount(&framecount);
+    clip->GetFrameRate(&framerate);
+    int64_t start, end;
+    std::string error = stream_range(static_cast<int64_t>(framecount), start, end);
+    if (error.size()) {
+        return error;
+    }
+
+    // frames are read and decoded ahead into a bounded reorder buffer and written in frame order,
+    // a slot is reused once its frame has been written.
+    int64_t slots = std::max(1, tool.streambuffer);
+    std::vector<ImageBuf> imagebufs(slots);
+    std::vector<int> states(slots, 0);  // 0 pending, 1 decoded, -1 failed
+    std::mutex mutex;
+    std::condition_variable condition;
+    callback->SetProcessed([&](ImageBuf* imageBuf, bool processed) {
+        std::lock_guard<std::mutex> lock(mutex);
+        states[imageBuf - imagebufs.data()] = processed ? 1 : -1;
+        condition.notify_all();
+    });
+
+    std::vector<float> pixels;
+    std::vector<unsigned char> buffer;
+    Timer timer;
+    int64_t submitted = start;
+    for (int64_t next = start; next <= end && !error.size(); next++) {
+        for (; submitted <= end && submitted - next < slots; submitted++) {
+            int64_t slot = submitted % slots;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                states[slot] = 0;
+            }
+            IBlackmagicRawJob* job = nullptr;
+            HRESULT result = clip->CreateJobReadFrame(submitted, &job);
+            if (result == S_OK) {
+                job->SetUserData(&imagebufs[slot]);
+                result = job->Submit();
+                if (result != S_OK) {
+                    job->Release();
+                }
+            }
+            if (result != S_OK) {
+                std::lock_guard<std::mutex> lock(mutex);
+                states[slot] = -1;
+            }
+        }
+        int64_t slot = next % slots;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [&]() { return states[slot] != 0; });
+            if (states[slot] < 0) {
+                error = "could not decode frame for stream: " + std::to_string(next);
+                break;
+            }
+        }
+        error = stream_frame(imagebufs[slot], variant, lutfile, framerate, next, next == start, pixels, buffer,
+                             stream);
+        imagebufs[slot].clear();
+    }
+    codec->FlushJobs();  // in flight jobs write to the reorder buffer
+    callback->SetProcessed(nullptr);
+    fflush(stream);
+    if (!error.size()) {
+        print_stream_rate(start, end, timer());
+    }
+    return error;
+}
+#endif
+
+std::string
+stream_source_frames(BrawFrameSource& source, const BrawVariant& variant, const std::string& lutfile, FILE* stream)
+{
+    // frames are read in order, synthetic sources need no reorder buffer
+    int64_t start, end;
+    std::string error = stream_range(source.frames(), start, end);
+    std::vector<float> pixels;
+    std::vector<unsigned char> buffer;
+    Timer timer;
+    for (int64_t frame = start; frame <= end && !error.size(); frame++) {
+        ImageBuf imageBuf;
+        std::vector<std::shared_ptr<float>> leases;
+        if (!source.read(frame, imageBuf, leases)) {
+            error = "could not read frame for stream: " + std::to_string(frame);
+            break;
+        }
+        error = stream_frame(imageBuf, variant, lutfile, source.framerate(), frame, frame == start, pixels, buffer,
+                             stream);
+    }
+    fflush(stream);
+    if (!error.size()) {
+        print_stream_rate(start, end, timer());
+    }
+    return error;
+}
+
+std::string
+write_stream(const std::function<std::string(FILE*)>& frames)
+{
+    FILE* stream = tool.stream == "-" ? stdout : fopen(tool.stream.c_str(), "wb");
+    if (!stream) {
+        return "could not open stream: " + tool.stream;
+    }
+    print_info("streaming " + tool.streamformat + " frames to: ", tool.stream == "-" ? "stdout" : tool.stream);
+    std::string error = frames(stream);
+    if (stream != stdout) {
+        fclose(stream);
+    }
+    return error;
+}
+
+// utils - proxy
+bool
+read_proxy_preview(BrawFrameSource& source, const std::string& inputfilename, const std::vector<BrawVariant>& variants,
+                   int scale, ImageBuf& imageBuf)
+{
+    // first frame of the camera proxy through the oiio movie reader when every requested size fits within it,
+    // recorded in the same log encoding so the sidecar 3dlut still applies, clip metadata needs no decode
+    std::string proxyfilename = combine_path(filename_path(inputfilename) + "/Proxy",
+                                             filename(extension(inputfilename, "mp4")));
+    if (tool.kelvin.has_value() || tool.tint.has_value() || tool.exposure.has_value()) {
+        return false;  // decode adjustments can not be applied to the recorded proxy
+    }
+    if (!exists(proxyfilename)) {
+        return false;
+    }
+    int clipwidth = std::max(1, source.width() / scale);
+    int clipheight = std::max(1, source.height() / scale);
+
+    // sizes are checked from the header before any pixels are decoded
+    ImageBuf proxybuf;
+    if (!proxybuf.init_spec(proxyfilename, 0, 0) || proxybuf.spec().nchannels < 3) {
+        print_warning("could not read proxy file, decoding braw: ", proxyfilename);
+        return false;
+    }
+    int proxywidth = proxybuf.spec().width;
+    int proxyheight = proxybuf.spec().height;
+    bool fits = true;
+    int width = 0, height = 0;  // largest requested size, resized straight from the proxy
+    for (const BrawVariant& variant : variants) {
+        int variantwidth, variantheight, resizewidth, resizeheight;
+        fit_size(clipwidth, clipheight, variant, variantwidth, variantheight, resizewidth, resizeheight);
+        fits = fits && resizewidth <= proxywidth && resizeheight <= proxyheight;
+        width = std::max(width, resizewidth);
+        height = std::max(height, resizeheight);
+    }
+    if (!fits) {
+        print_info("proxy is smaller than requested size, decoding braw: ",
+                   str_by_int(proxywidth) + "x" + str_by_int(proxyheight));
+        return false;
+    }
+    if (!proxybuf.read(0, 0, true, TypeDesc::FLOAT)) {
+        print_warning("could not read proxy file, decoding braw: ", proxyfilename);
+        return false;
+    }
+    // scaled previews resize once to the requested size, full size variants are resized from the proxy later
+    if (scale > 1 && (width != proxywidth || height != proxyheight)) {
+        resize_image(imageBuf, proxybuf, tool.resizefilter, ROI(0, width, 0, height, 0, 1, 0, 3));
+    }
+    else {
+        ImageBufAlgo::channels(imageBuf, proxybuf, 3, {});
+    }
+    source.read_metadata(0, imageBuf);
+    return true;
+}
+
+// braw scheduler
+class BrawScheduler {
+public:
+    enum Lane { Cpu = 0, Io = 1 };
+    enum Priority { Preview = 0, Render = 1, Clone = 2 };
+
+    void add(Lane lane, Priority priority, std::function<bool()> task)
+    {
+        m_tasks[lane][std::make_pair(priority, m_sequence++)] = task;
+        m_pending[priority]++;
+    }
+
+    bool run()
+    {
+        // one worker per lane, the sdk already decodes on all cores and the io lane keeps raid reads sequential
+        std::vector<std::thread> workers;
+        for (int lane = 0; lane < lanes; lane++) {
+            workers.emplace_back([this, lane]() { work(lane); });
+        }
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+        return !m_failed;
+    }
+
+private:
+    void work(int lane)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (m_tasks[lane].size()) {
+            auto it = m_tasks[lane].begin();
+            int priority = it->first.first;
+            if (priority != Preview && m_pending[Preview] > 0) {
+                m_condition.wait(lock);  // previews of all clips come first
+                continue;
+            }
+            std::function<bool()> task = it->second;
+            m_tasks[lane].erase(it);
+            lock.unlock();
+            bool succeeded = task();
+            lock.lock();
+            m_failed = m_failed || !succeeded;
+            m_pending[priority]--;
+            m_condition.notify_all();
+        }
+    }
+
+    static const int lanes = 2;
+    std::map<std::pair<int, size_t>, std::function<bool()>> m_tasks[lanes];
+    std::map<int, int> m_pending;
+    size_t m_sequence = 0;
+    bool m_failed = false;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+};
+
+int
+clone_clip(const std::string& inputfilename)
+{
+    // clone braw
+    if (tool.clonebraw && tool.trimstart >= 0) {
+        print_info("skipping clone of braw file, trimmed file is written instead");
+    }
+    else if (tool.clonebraw && tool.syntheticwidth > 0 && !exists(inputfilename)) {
+        print_warning("skipping clone of synthetic clip without input file: ", inputfilename);
+    }
+    else if (tool.clonebraw) {
+        std::string clonefilename = combine_path(tool.outputdirectory, filename(inputfilename));
+        copy_file(inputfilename, clonefilename);
+        if (!file_compare(inputfilename, clonefilename)) {
+            print_error("failed when trying to clone input file to: ", clonefilename);
+            metrics.failure("clone");
+            return EXIT_FAILURE;
+        }
+    }
+
+    // clone proxy
+    if (tool.cloneproxy) {
+        std::string proxydirname = combine_path(tool.outputdirectory, "Proxy");
+        if (!exists(proxydirname)) {
+            if (!create_path(proxydirname)) {
+                print_error("could not create proxy directory: ", proxydirname);
+                metrics.failure("clone");
+                return EXIT_FAILURE;
+            }
+        }
+
+        // mp4
+        std::string mp4file = combine_path(filename_path(inputfilename) + "/Proxy",
+                                           filename(extension(inputfilename, "mp4")));
+        if (exists(mp4file)) {
+            std::string mp4outputfile = combine_path(proxydirname, filename(mp4file));
+            copy_file(mp4file, mp4outputfile);
+            if (!file_compare(mp4file, mp4outputfile)) {
+                print_error("failed when trying to clone mp4 file to: ", mp4outputfile);
+                metrics.failure("clone");
+                return EXIT_FAILURE;
+            }
+        }
+        else {
+            print_warning("could not find proxy mp4 file: ", mp4file);
+        }
+
+        // sidecar
+        std::string sidecarfile = combine_path(filename_path(inputfilename) + "/Proxy",
+                                               filename(extension(inputfilename, "sidecar")));
+        if (exists(sidecarfile)) {
+            std::string sidecaroutputfile = combine_path(proxydirname, filename(sidecarfile));
+            copy_file(sidecarfile, sidecaroutputfile);
+            if (!file_compare(sidecarfile, sidecaroutputfile)) {
+                print_error("failed when trying to clone sidecar file to: ", sidecaroutputfile);
+                metrics.failure("clone");
+                return EXIT_FAILURE;
+            }
+        }
+        else {
+            print_warning("could not find proxy mp4 file: ", mp4file);
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+int
+preview_clip(BrawSession& session, const std::string& inputfilename)
+{
+    // eighth resolution decode with metadata, cheap enough to run for every clip before other work
+    Timer timer;
+    ImageBuf imageBuf;
+    std::vector<std::shared_ptr<float>> leases;
+    std::unique_ptr<BrawFrameSource> source = frame_source(session);
+    if (!source->open(inputfilename)) {
+        metrics.failure("preview");
+        return EXIT_FAILURE;
+    }
+    if (tool.proxypreview && !tool.crop.has_value()
+        && read_proxy_preview(*source, inputfilename, { session.thumbnailvariant }, 8, imageBuf)) {
+        print_info("read thumbnail from proxy for input filename: ", inputfilename);
+    }
+    else {
+        source->set_scale(8);
+        if (tool.crop.has_value()) {
+            const ROI& crop = tool.crop.value();  // in eighth resolution pixels, rounded outwards
+            source->set_crop(ROI(crop.xbegin / 8, (crop.xend + 7) / 8, crop.ybegin / 8, (crop.yend + 7) / 8));
+        }
+        if (!source->read(0, imageBuf, leases)) {
+            print_error("could not decode preview for input filename: ", inputfilename);
+            metrics.failure("preview");
+            return EXIT_FAILURE;
+        }
+    }
+
+    const BrawVariant& variant = session.thumbnailvariant;
+    std::string lutfile;
+    if (variant.lut.size() && !read_3dlut(session, variant.lut, inputfilename, lutfile)) {
+        metrics.failure("3dlut");
+        return EXIT_FAILURE;
+    }
+    std::string outputfilename = variant_filename(inputfilename, tool.outputdirectory, variant);
+    std::string error = finish_variant(imageBuf, variant, lutfile, inputfilename, outputfilename);
+    if (error.size()) {
+        print_error(error);
+        metrics.failure("preview");
+        return EXIT_FAILURE;
+    }
+    print_info("wrote thumbnail in " + std::to_string(timer()) + "s to file: ", outputfilename);
+    return EXIT_SUCCESS;
+}
+
+int
+render_clip(BrawSession& session, const std::string& inputfilename)
+{
+    const std::vector<BrawVariant>& variants = session.variants;
+    const BrawVariant& wedgevariant = session.wedgevariant;
+    const BrawVariant& streamvariant = session.streamvariant;
+
+    // read 3dlut
+    std::map<std::string, std::string> lutfiles;
+    std::vector<BrawVariant> lutvariants = variants;
+    if (tool.wedges.size()) {
+        lutvariants.push_back(wedgevariant);
+    }
+    if (tool.stream.size()) {
+        lutvariants.push_back(streamvariant);
+    }
+    for (const BrawVariant& variant : lutvariants) {
+        if (!variant.lut.size() || lutfiles.count(variant.lut)) {
+            continue;
+        }
+        std::string lutfile;
+        if (!read_3dlut(session, variant.lut, inputfilename, lutfile)) {
+            metrics.failure("3dlut");
+            return EXIT_FAILURE;
+        }
+        lutfiles[variant.lut] = lutfile;
+    }
+
+    // frame cache
+    const long frame = 0;
+    std::vector<std::shared_ptr<float>> leases;  // pooled pixels, released after the images below
+    ImageBuf imageBuf;
+    std::vector<ImageBuf> wedgebufs;
+    BrawStats stats;
+    std::string cachefilename;
+    bool cached = false;
+    bool needsclip = tool.trimstart >= 0 || tool.wedges.size() || tool.extractaudio || tool.stream.size();
+    if (tool.cachedirectory.size() && tool.syntheticwidth <= 0) {
+        std::string key = cache_key(inputfilename, frame);
+        if (!exists(tool.cachedirectory) && !create_path(tool.cachedirectory)) {
+            print_warning("could not create cache directory: ", tool.cachedirectory);
+        }
+        else if (key.size()) {
+            cachefilename = combine_path(tool.cachedirectory, key + ".exr");
+        }
+        if (cachefilename.size() && !needsclip && exists(cachefilename)) {
+            print_info("reading cached frame from file: ", cachefilename);
+            cached = read_cache(cachefilename, imageBuf, tool.stats ? &stats : nullptr);
+            if (!cached) {
+                print_warning("could not read cached frame, decoding: ", cachefilename);
+            }
+        }
+        metrics.count(cached ? "brawtool_frame_cache_hits_total" : "brawtool_frame_cache_misses_total");
+    }
+
+    // frame source, also opens the clip for trim, wedges, audio and streaming
+    std::unique_ptr<BrawFrameSource> framesource;
+    bool sourced = !cached && (!needsclip || tool.syntheticwidth > 0);
+    if (!cached) {
+        framesource = frame_source(session);
+        if (!framesource->open(inputfilename)) {
+            metrics.failure("decode");
+            return EXIT_FAILURE;
+        }
+        if (tool.crop.has_value()) {
+            const ROI& crop = tool.crop.value();
+            if (crop.xend > framesource->width() || crop.yend > framesource->height()) {
+                print_error("crop is outside of clip size: ",
+                            str_by_int(framesource->width()) + "x" + str_by_int(framesource->height()));
+                metrics.failure("arguments");
+                return EXIT_FAILURE;
+            }
+            framesource->set_crop(crop);
+        }
+        if (tool.stats) {
+            framesource->set_stats(&stats);
+        }
+    }
+
+    // proxy preview
+    bool proxied = false;
+    if (sourced && tool.proxypreview && !needsclip && !tool.crop.has_value() && !tool.stats) {
+        proxied = read_proxy_preview(*framesource, inputfilename, variants, 1, imageBuf);
+        if (proxied) {
+            print_info("read preview from proxy for input filename: ", inputfilename);
+        }
+    }
+
+    // read source frame
+    if (sourced && !proxied) {
+        print_info("reading frame from input filename: ", inputfilename);
+        Timer decodetimer;
+        if (!framesource->read(frame, imageBuf, leases)) {
+            print_error("could not read frame for input filename: ", inputfilename);
+            metrics.failure("decode");
+            return EXIT_FAILURE;
+        }
+        metrics.observe("brawtool_decode_seconds", decodetimer());
+        metrics.count("brawtool_frames_processed_total");
+
+        // stream frames
+        if (tool.stream.size()) {
+            framesource->set_stats(nullptr);  // stats describe the rendered frame only
+            std::string lutfile = streamvariant.lut.size() ? lutfiles.at(streamvariant.lut) : "";
+            std::string error = write_stream(
+                [&](FILE* stream) { return stream_source_frames(*framesource, streamvariant, lutfile, stream); });
+            if (error.size()) {
+                print_error(error);
+                metrics.failure("stream");
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+#if defined(BlackmagicRaw_FOUND)
+    // read braw data, trim, wedges, audio and streaming need the opened clip
+    if (!cached && !sourced) {
+        print_info("reading braw data from file: ", inputfilename);
+        HRESULT result = S_OK;
+        // codec is kept between clips, the clip is opened and released by the frame source
+        IBlackmagicRaw* codec = session.codec;
+        IBlackmagicRawClip* clip = static_cast<BrawDecodeSource&>(*framesource).clip();
+
+        // extract audio, read next to the frame decode from the same opened clip
+        std::future<std::string> audiofuture;
+        if (tool.extractaudio) {
+            std::string audiofilename = combine_path(tool.outputdirectory,
+                                                     filename(extension(inputfilename, "wav")));
+            print_info("extracting audio to file: ", audiofilename);
+            audiofuture = std::async(std::launch::async, extract_audio, clip, inputfilename, audiofilename);
+        }
+
+        BrawCallback* callback = new BrawCallback();
+        callback->AddRef();
+        BrawCallbackRef callbackref(callback, BrawCallbackRelease { codec });
+        configure_callback(callback, tool.stats ? &stats : nullptr, tool.crop);
+        if (tool.wedges.size()) {
+            callback->SetWedges(tool.wedges);
+        }
+
+        result = codec->SetCallback(callback);
+        if (result != S_OK) {
+            print_error("could not set callback for input filename: ", inputfilename);
+            metrics.failure("decode");
+            return EXIT_FAILURE;
+        }
+
+        IBlackmagicRawMetadataIterator* clipMetadataIterator = nullptr;
+        result = clip->GetMetadataIterator(&clipMetadataIterator);
+        BrawRef<IBlackmagicRawMetadataIterator> clipMetadataIteratorRef(clipMetadataIterator);
+        if (result != S_OK) {
+            print_error("could not set get clip meta data for input filename: ", inputfilename);
+            metrics.failure("decode");
+            return EXIT_FAILURE;
+        }
+
+        Timer decodetimer;
+        IBlackmagicRawJob* job = nullptr;
+        result = clip->CreateJobReadFrame(frame, &job);
+        if (result != S_OK) {
+            print_error("could not read frame for input filename: ", inputfilename);
+            metrics.failure("decode");
+            return EXIT_FAILURE;
+        }
+
+        result = job->Submit();
+        if (result != S_OK) {
+            job->Release();
+            print_error("could not submit job for input filename: ", inputfilename);
+            metrics.failure("decode");
+            return EXIT_FAILURE;
+        }
+        codec->FlushJobs();
+        metrics.observe("brawtool_decode_seconds", decodetimer());
+        metrics.count("brawtool_frames_processed_total", static_cast<double>(1 + tool.wedges.size()));
+
+        IBlackmagicRawFrame* frame = callback->GetFrame();
+        if (frame == nullptr) {
+            print_error("could not get frame for input filename: ", inputfilename);
+            metrics.failure("decode");
+            return EXIT_FAILURE;
+        }
+
+        IBlackmagicRawMetadataIterator* frameMetadataIterator = nullptr;
+        result = frame->GetMetadataIterator(&frameMetadataIterator);
+        BrawRef<IBlackmagicRawMetadataIterator> frameMetadataIteratorRef(frameMetadataIterator);
+        if (result != S_OK) {
+            print_error("could not get frame meta data for input filename: ", inputfilename);
+            metrics.failure("decode");
+            return EXIT_FAILURE;
+        }
+
+        // metadata
+        callback->ProcessMetaData(clipMetadataIterator);
+        callback->ProcessMetaData(frameMetadataIterator);
+
+        imageBuf = callback->GetImageBuf();  // shares the pooled pixels
+        if (imageBuf.has_error()) {
+            print_error("could not read image buffer from filename: ", inputfilename);
+        }
+
+        // wedges
+        wedgebufs = callback->TakeWedgeBufs();
+        leases = callback->TakeLeases();
+        for (ImageBuf& wedgebuf : wedgebufs) {
+            if (!wedgebuf.initialized()) {
+                print_error("could not decode wedge for input filename: ", inputfilename);
+                metrics.failure("wedge");
+                return EXIT_FAILURE;
+            }
+            copy_attributes(wedgebuf, imageBuf.spec());
+        }
+
+        // trim braw
+        if (tool.trimstart >= 0) {
+            uint64_t framecount = 0;
+            clip->GetFrameCount(&framecount);
+            if (tool.trimend < tool.trimstart || static_cast<uint64_t>(tool.trimend) >= framecount) {
+                print_error("trim range is outside of clip frames: ", "0-" + std::to_string(framecount - 1));
+                metrics.failure("trim");
+                return EXIT_FAILURE;
+            }
+            uint64_t trimcount = tool.trimend - tool.trimstart + 1;
+            std::string trimfilename = combine_path(tool.outputdirectory, filename(inputfilename));
+            boost::system::error_code error;
+            if (boost::filesystem::equivalent(trimfilename, inputfilename, error)) {
+                print_error("trimmed file would overwrite input file: ", trimfilename);
+                metrics.failure("trim");
+                return EXIT_FAILURE;
+            }
+            print_info("trimming braw frames " + str_by_int(tool.trimstart) + "-" + str_by_int(tool.trimend)
+                           + " to file: ",
+                       trimfilename);
+
+            CFStringRef trimfilenameref = cfstr_by_str(trimfilename);
+            BrawCFRef trimfilenamerelease(trimfilenameref);
+            IBlackmagicRawJob* trimJob = nullptr;
+            result = clip->CreateJobTrim(trimfilenameref, tool.trimstart, trimcount, nullptr, nullptr, &trimJob);
+            if (result == S_OK) {
+                result = trimJob->Submit();
+                if (result != S_OK) {
+                    trimJob->Release();
+                }
+            }
+            if (result == S_OK) {
+                codec->FlushJobs();
+                result = callback->GetTrimResult();
+            }
+            if (result != S_OK) {
+                print_error("could not trim input filename: ", inputfilename);
+                metrics.failure("trim");
+                return EXIT_FAILURE;
+            }
+
+            // verify
+            IBlackmagicRawClip* trimclip = nullptr;
+            uint64_t trimframecount = 0;
+            uint32_t width = 0, height = 0, trimwidth = 0, trimheight = 0;
+            result = codec->OpenClip(trimfilenameref, &trimclip);
+            if (result == S_OK) {
+                trimclip->GetFrameCount(&trimframecount);
+                trimclip->GetWidth(&trimwidth);
+                trimclip->GetHeight(&trimheight);
+                clip->GetWidth(&width);
+                clip->GetHeight(&height);
+                trimclip->Release();
+            }
+            if (result != S_OK || trimframecount != trimcount || trimwidth != width || trimheight != height) {
+                print_error("failed when verifying trimmed file: ", trimfilename);
+                metrics.failure("trim");
+                return EXIT_FAILURE;
+            }
+            print_info("verified trimmed file frames: ", std::to_string(trimframecount));
+            metrics.count("brawtool_cloned_bytes_total",
+                          static_cast<double>(boost::filesystem::file_size(trimfilename)));
+        }
+        // stream frames
+        if (tool.stream.size()) {
+            std::string lutfile = streamvariant.lut.size() ? lutfiles.at(streamvariant.lut) : "";
+            std::string error = write_stream([&](FILE* stream) {
+                return stream_frames(codec, clip, callback, streamvariant, lutfile, stream);
+            });
+            if (error.size()) {
+                print_error(error);
+                metrics.failure("stream");
+                return EXIT_FAILURE;
+            }
+        }
+        if (audiofuture.valid()) {
+            std::string error = audiofuture.get();
+            if (error.size()) {
+                print_error(error);
+                metrics.failure("audio");
+                return EXIT_FAILURE;
+            }
+        }
     }
+#endif
 
-    virtual void ReadComplete(IBlackmagicRawJob* job, HRESULT result, IBlackmagicRawFrame* frame)
-    {
-        IBlackmagicRawJob* decodeAndProcessJob = nullptr;
-        BlackmagicRawResourceFormat format = blackmagicRawResourceFormatRGBF32;  // we always read float 32
-        if (result == S_OK) {
-            frame->SetResourceFormat(format);
+    // write frame cache
+    if (!cached && !proxied && cachefilename.size() && imageBuf.localpixels()) {
+        print_info("writing cached frame to file: ", cachefilename);
+        if (!write_cache(imageBuf, cachefilename)) {
+            print_warning("could not write cached frame: ", cachefilename);
         }
-        if (result == S_OK) {
-            IBlackmagicRawFrameProcessingAttributes* frameProcessingAttributes;
-            frame->CloneFrameProcessingAttributes(&frameProcessingAttributes);
-            if (m_kelvin.has_value()) {
-                Variant variant;
-                variant.vt = blackmagicRawVariantTypeU32;
-                variant.uintVal = m_kelvin.value();
-                frameProcessingAttributes->SetFrameAttribute(blackmagicRawFrameProcessingAttributeWhiteBalanceKelvin,
-                                                             &variant);
-            }
-            if (m_tint.has_value()) {
-                Variant variant;
-                variant.vt = blackmagicRawVariantTypeS16;
-                variant.uintVal = m_tint.value();
-                frameProcessingAttributes->SetFrameAttribute(blackmagicRawFrameProcessingAttributeWhiteBalanceTint,
-                                                             &variant);
-            }
-            if (m_exposure.has_value()) {
-                Variant variant;
-                variant.vt = blackmagicRawVariantTypeFloat32;
-                variant.fltVal = m_exposure.value();
-                frameProcessingAttributes->SetFrameAttribute(blackmagicRawFrameProcessingAttributeExposure, &variant);
-            }
-            result = frame->CreateJobDecodeAndProcessFrame(nullptr, frameProcessingAttributes, &decodeAndProcessJob);
+        evict_cache(tool.cachedirectory, static_cast<uint64_t>(tool.cachesize) * 1024 * 1024);
+    }
+
+    // write stats
+    if (tool.stats) {
+        std::string statsfilename = combine_path(tool.outputdirectory,
+                                                 filename(extension(inputfilename, "stats.json")));
+        print_info("writing stats file: ", statsfilename);
+        if (!stats.write(statsfilename)) {
+            print_error("could not write stats file: ", statsfilename);
+            metrics.failure("stats");
+            return EXIT_FAILURE;
         }
-        if (result == S_OK) {
-            result = decodeAndProcessJob->Submit();
+    }
+
+    // resize variants
+    Timer postprocesstimer;
+    std::vector<ImageBuf> variantbufs(variants.size());
+    std::vector<ROI> variantsizes(variants.size());
+    {
+        const ImageSpec spec = imageBuf.spec();
+        std::vector<ROI> resizes(variants.size());
+        for (size_t i = 0; i < variants.size(); i++) {
+            int width, height, resizewidth, resizeheight;
+            fit_size(spec.width, spec.height, variants[i], width, height, resizewidth, resizeheight);
+            variantsizes[i] = ROI(0, width, 0, height);
+            resizes[i] = ROI(0, resizewidth, 0, resizeheight);
         }
-        if (result != S_OK) {
-            if (decodeAndProcessJob)
-                decodeAndProcessJob->Release();
+
+        // largest first, so that smaller variants can be derived from already resized ones
+        std::vector<size_t> order(variants.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return resizes[a].npixels() > resizes[b].npixels();
+        });
+
+        std::vector<size_t> resized;
+        std::vector<size_t> fullsize;
+        for (size_t i : order) {
+            if (resizes[i].width() == spec.width && resizes[i].height() == spec.height) {
+                fullsize.push_back(i);
+                continue;
+            }
+            const ImageBuf* source = &imageBuf;
+            for (size_t j : resized) {
+                const ImageSpec& resizedspec = variantbufs[j].spec();
+                if (resizedspec.width >= resizes[i].width() && resizedspec.height >= resizes[i].height()
+                    && resizedspec.width < source->spec().width) {
+                    source = &variantbufs[j];
+                }
+            }
+            print_info("resizing variant to: ",
+                       str_by_int(resizes[i].width()) + "x" + str_by_int(resizes[i].height()));
+            variantbufs[i] = pooled_image(ImageSpec(resizes[i].width(), resizes[i].height(), spec.nchannels,
+                                                    TypeDesc::FLOAT),
+                                          leases);
+            resize_image(variantbufs[i], *source, tool.resizefilter, resizes[i]);
+            copy_attributes(variantbufs[i], spec);
+            resized.push_back(i);
         }
-        if (result == S_OK) {
-            SetFrame(frame);
+        for (size_t i = 0; i < fullsize.size(); i++) {
+            if (i + 1 < fullsize.size()) {
+                variantbufs[fullsize[i]] = pooled_image(spec, leases);  // luts are applied in place
+                variantbufs[fullsize[i]].copy_pixels(imageBuf);
+            }
+            else {
+                variantbufs[fullsize[i]] = std::move(imageBuf);  // last full size variant takes the decoded image
+            }
         }
-        job->Release();
     }
 
-    virtual void ProcessComplete(IBlackmagicRawJob* job, HRESULT result, IBlackmagicRawProcessedImage* processedImage)
+    // render variants
     {
-        unsigned int width = 0;
-        unsigned int height = 0;
-        unsigned int sizeBytes = 0;
-        void* imageData = nullptr;
-        if (result == S_OK) {
-            result = processedImage->GetWidth(&width);
+        for (size_t i = 0; i < variants.size(); i++) {
+            print_info("writing output file: ",
+                       variant_filename(inputfilename, tool.outputdirectory, variants[i]));
         }
-        if (result == S_OK) {
-            result = processedImage->GetHeight(&height);
+        std::vector<std::string> errors(variants.size());
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < variants.size(); i++) {
+            threads.emplace_back([&, i]() {
+                std::string lutfile = variants[i].lut.size() ? lutfiles.at(variants[i].lut) : "";
+                errors[i] = render_variant(variantbufs[i], variants[i], variantsizes[i].width(),
+                                           variantsizes[i].height(), lutfile, inputfilename,
+                                           tool.outputdirectory);
+            });
         }
-        if (result == S_OK) {
-            result = processedImage->GetResourceSizeBytes(&sizeBytes);
+        for (std::thread& thread : threads) {
+            thread.join();
         }
-        if (result == S_OK) {
-            result = processedImage->GetResource(&imageData);
+        bool failed = false;
+        for (const std::string& error : errors) {
+            if (error.size()) {
+                print_error(error);
+                failed = true;
+            }
         }
-        if (result == S_OK) {
-            ProcessImage(width, height, sizeBytes, imageData);
+        if (failed) {
+            metrics.failure("render");
+            return EXIT_FAILURE;
         }
-        job->Release();
     }
 
-    virtual void ProcessImage(uint32_t width, uint32_t height, uint32_t size, void* image)
-    {
-        const int channels = 3;
-        const OIIO::TypeDesc format = OIIO::TypeDesc::FLOAT;
-        ImageSpec spec(width, height, channels, format);
-        m_imageBuf = ImageBuf(spec);
-        m_imageBuf.set_pixels(OIIO::ROI(0, width, 0, height, 0, 1, 0, channels), format, image);
+    // render wedges
+    if (wedgebufs.size()) {
+        std::string lutfile = wedgevariant.lut.size() ? lutfiles.at(wedgevariant.lut) : "";
+        std::string error = tool.wedgegrid ? render_wedge_grid(wedgebufs, tool.wedges, wedgevariant, lutfile,
+                                                               inputfilename, tool.outputdirectory)
+                                           : render_wedges(wedgebufs, tool.wedges, wedgevariant, lutfile,
+                                                           inputfilename, tool.outputdirectory);
+        if (error.size()) {
+            print_error(error);
+            metrics.failure("render");
+            return EXIT_FAILURE;
+        }
     }
+    metrics.observe("brawtool_postprocess_seconds", postprocesstimer());
+    metrics.count("brawtool_clips_processed_total");
+    return EXIT_SUCCESS;
+}
 
-    void ProcessMetaData(IBlackmagicRawMetadataIterator* metadataIterator)
+int
+process_clip(BrawSession& session, const std::string& inputfilename)
+{
+    if (tool.thumbnail && preview_clip(session, inputfilename) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+    if (render_clip(session, inputfilename) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+    return clone_clip(inputfilename);
+}
+
+
+// braw watch
+static std::atomic<bool> watching(true);
+
+static void
+stop_watching(int)
+{
+    watching = false;
+}
+
+std::string
+watch_state(const std::string& path)
+{
+    // the clip and its proxy files, any change restarts the wait for a fully written clip
+    std::string proxypath = filename_path(path) + "/Proxy";
+    std::string mp4file = combine_path(proxypath, filename(extension(path, "mp4")));
+    std::string sidecarfile = combine_path(proxypath, filename(extension(path, "sidecar")));
+    return hash_key(path) + "|" + hash_key(mp4file) + "|" + hash_key(sidecarfile);
+}
+
+int
+watch_directories(BrawSession& session)
+{
+    std::string journalfilename = tool.watchjournal.size() ? tool.watchjournal
+                                                           : combine_path(tool.outputdirectory, ".brawtool_watch");
+    std::set<std::string> completed;  // absolute path and identity of clips in the journal
+    std::set<std::string> failed;     // retried once the clip or its proxy files change
     {
-        char buffer[m_buffersize];
-        const char* str = nullptr;
-        CFStringRef key = nullptr;
-        Variant value;
-        HRESULT result;
-        std::string attribute;
-        while (SUCCEEDED(metadataIterator->GetKey(&key))) {
-            if (CFStringGetCString(key, buffer, m_buffersize, kCFStringEncodingMacRoman)) {
-                str = buffer;
-                attribute.clear();
-                attribute += str;
-            }
-            VariantInit(&value);
-            result = metadataIterator->GetData(&value);
-            if (result != S_OK) {
-                print_warning("could not get data from meta data iterator");
-                break;
-            }
-            BlackmagicRawVariantType variantType = value.vt;
-            std::ostringstream valueStream;
-            switch (variantType) {
-            case blackmagicRawVariantTypeS16: m_imageBuf.specmod().attribute(attribute, value.iVal); break;
-            case blackmagicRawVariantTypeU16: m_imageBuf.specmod().attribute(attribute, value.uiVal); break;
-            case blackmagicRawVariantTypeS32: m_imageBuf.specmod().attribute(attribute, value.intVal); break;
-            case blackmagicRawVariantTypeU32: m_imageBuf.specmod().attribute(attribute, value.uintVal); break;
-            case blackmagicRawVariantTypeFloat32: m_imageBuf.specmod().attribute(attribute, value.fltVal); break;
-            case blackmagicRawVariantTypeString:
-                if (CFStringGetCString(value.bstrVal, buffer, m_buffersize, kCFStringEncodingMacRoman)) {
-                    m_imageBuf.specmod().attribute(attribute, buffer);
+        std::ifstream journal(journalfilename);
+        std::string line;
+        while (getline(journal, line)) {
+            completed.insert(line);
+        }
+    }
+    print_info("watching directories with journal: ", journalfilename);
+
+#if defined(__linux__)
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) {
+        print_warning("could not initialize inotify, polling directories with interval: ", tool.watchinterval);
+    }
+    std::set<std::string> watched;
+#endif
+    signal(SIGINT, stop_watching);  // the clip in progress is finished before exiting
+    signal(SIGTERM, stop_watching);
+
+    std::map<std::string, std::pair<std::string, double>> pending;  // state and time since unchanged
+    Timer timer;
+    int code = EXIT_SUCCESS;
+    while (watching) {
+#if defined(__linux__)
+        bool unwatched = false;  // directories created later are only found by polling
+#endif
+        for (const std::string& directory : tool.watchdirectories) {
+#if defined(__linux__)
+            for (const std::string& path : { directory, directory + "/Proxy" }) {
+                if (fd >= 0 && !watched.count(path) && exists(path)) {
+                    if (inotify_add_watch(fd, path.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) >= 0) {
+                        watched.insert(path);
+                    }
                 }
-                break;
-            case blackmagicRawVariantTypeSafeArray: {
-                SafeArray* safeArray = value.parray;
-                void* safeArrayData = nullptr;
-                result = SafeArrayAccessData(safeArray, &safeArrayData);
-                if (result != S_OK) {
-                    print_warning("could not get safe array access in meta data iterator");
-                    break;
+            }
+            unwatched = unwatched || !watched.count(directory);
+#endif
+            boost::system::error_code error;
+            for (boost::filesystem::directory_iterator it(directory, error), end; !error && it != end;
+                 it.increment(error)) {
+                if (Strutil::lower(it->path().extension().string()) != ".braw"
+                    || !boost::filesystem::is_regular_file(it->path(), error)) {
+                    continue;
                 }
-
-                BlackmagicRawVariantType arrayVarType;
-                result = SafeArrayGetVartype(safeArray, &arrayVarType);
-                if (result != S_OK) {
-                    print_warning("could not get variant type from safe array in meta data iterator");
-                    SafeArrayUnaccessData(safeArray);
-                    break;
+                std::string path = boost::filesystem::absolute(it->path()).string();
+                // proxy files landing after a clip completed do not process it again
+                std::string entry = path + "\t" + hash_key(path);
+                std::string state = watch_state(path);
+                if (completed.count(entry) || failed.count(path + "\t" + state)) {
+                    pending.erase(path);
+                    continue;
                 }
-                long lBound, uBound;
-                SafeArrayGetLBound(safeArray, 1, &lBound);
-                SafeArrayGetUBound(safeArray, 1, &uBound);
-                std::ostringstream arrayValues;
-                for (long i = lBound; i <= uBound; i++) {
-                    switch (arrayVarType) {
-                    case blackmagicRawVariantTypeU8:
-                        arrayValues << static_cast<unsigned char*>(safeArrayData)[i - lBound];
-                        break;
-                    case blackmagicRawVariantTypeS16:
-                        arrayValues << static_cast<short*>(safeArrayData)[i - lBound];
-                        break;
-                    case blackmagicRawVariantTypeU16:
-                        arrayValues << static_cast<unsigned short*>(safeArrayData)[i - lBound];
-                        break;
-                    case blackmagicRawVariantTypeS32:
-                        arrayValues << static_cast<int*>(safeArrayData)[i - lBound];
-                        break;
-                    case blackmagicRawVariantTypeU32:
-                        arrayValues << static_cast<unsigned int*>(safeArrayData)[i - lBound];
-                        break;
-                    case blackmagicRawVariantTypeFloat32:
-                        arrayValues << static_cast<float*>(safeArrayData)[i - lBound];
-                        break;
+                auto clip = pending.find(path);
+                if (clip == pending.end() || clip->second.first != state) {
+                    if (clip == pending.end()) {
+                        print_info("waiting for clip to be fully written: ", path);
                     }
-                    if (i < uBound)
-                        arrayValues << ", ";  // Add a comma except for the last element
+                    pending[path] = std::make_pair(state, timer());
+                    continue;
+                }
+                if (timer() - clip->second.second < tool.watchinterval) {
+                    continue;
+                }
+                pending.erase(path);
+                print_info("processing clip: ", path);
+                if (process_clip(session, path) == EXIT_SUCCESS) {
+                    completed.insert(entry);
+                    std::ofstream journal(journalfilename, std::ios::app);
+                    journal << entry << std::endl;
+                }
+                else {
+                    failed.insert(path + "\t" + state);
+                    print_warning("could not process clip, retried when changed: ", path);
+                    code = EXIT_FAILURE;
+                }
+                if (!watching) {
+                    break;
                 }
-                SafeArrayUnaccessData(safeArray);
-                m_imageBuf.specmod().attribute(attribute, arrayValues.str());
-            } break;
-            default: break;
             }
-            VariantClear(&value);
-            metadataIterator->Next();
         }
-    }
-    virtual void DecodeComplete(IBlackmagicRawJob*, HRESULT) {}
-    virtual void TrimProgress(IBlackmagicRawJob*, float) {}
-    virtual void TrimComplete(IBlackmagicRawJob*, HRESULT) {}
-    virtual void SidecarMetadataParseWarning(IBlackmagicRawClip*, CFStringRef, uint32_t, CFStringRef) {}
-    virtual void SidecarMetadataParseError(IBlackmagicRawClip*, CFStringRef, uint32_t, CFStringRef) {}
-    virtual void PreparePipelineComplete(void*, HRESULT) {}
-    virtual HRESULT STDMETHODCALLTYPE QueryInterface(REFIID, LPVOID*) { return E_NOTIMPL; }
-    virtual ULONG STDMETHODCALLTYPE AddRef(void) { return ++m_refCount; }
-
-    virtual ULONG STDMETHODCALLTYPE Release(void)
-    {
-        const int32_t newRefValue = --m_refCount;
-        if (newRefValue == 0) {
-            delete this;
+        if (!watching) {
+            break;
         }
-        assert(newRefValue >= 0);
-        return newRefValue;
-    }
-    float GetKelvin() const { return m_kelvin.value(); }
-    void SetKelvin(float kelvin) { m_kelvin = kelvin; }
-    float GetTint() const { return m_tint.value(); }
-    void SetTint(float tint) { m_tint = tint; }
-    float GetExposure() const { return m_exposure.value(); }
-    void SetExposure(float exposure) { m_exposure = exposure; }
-    ImageBuf GetImageBuf() { return m_imageBuf; }
-    IBlackmagicRawFrame* GetFrame() { return m_frame; }
-    void SetFrame(IBlackmagicRawFrame* frame)
-    {
-        if (m_frame != nullptr) {
-            m_frame->Release();
+#if defined(__linux__)
+        if (fd >= 0) {
+            // sleep until files change, or until pending clips may have become stable
+            pollfd pfd = { fd, POLLIN, 0 };
+            if (poll(&pfd, 1, pending.size() || unwatched ? tool.watchinterval * 1000 : -1) > 0) {
+                char buffer[4096];
+                while (read(fd, buffer, sizeof(buffer)) > 0) {
+                }
+            }
+            continue;
         }
-        m_frame = frame;
-        if (m_frame != nullptr) {
-            m_frame->AddRef();
+#endif
+        for (int i = 0; i < tool.watchinterval * 10 && watching; i++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
         }
     }
-
-private:
-    boost::optional<int> m_kelvin;
-    boost::optional<int> m_tint;
-    boost::optional<float> m_exposure;
-    IBlackmagicRawFrame* m_frame = nullptr;
-    ImageBuf m_imageBuf;
-    std::atomic<int32_t> m_refCount = { 0 };
-    const int m_buffersize = 1024;
-};
-
-// braw colorspace
-struct BrawColorspace {
-    std::string description;
-    std::string filename;
-};
-
-
+#if defined(__linux__)
+    if (fd >= 0) {
+        close(fd);
+    }
+#endif
+    print_info("stopped watching directories");
+    return code;
+}
 
 // main
 int
@@ -584,9 +4551,25 @@ main(int argc, const char* argv[])
     ap.separator("General flags:");
     ap.arg("--help", &tool.help).help("Print help message");
 
-    ap.arg("-v", &tool.verbose).help("Verbose status messages");
+    ap.arg("-v", &tool.verbose).help("Verbose status messages");
+
+    ap.arg("filename").hidden().action(set_inputfilenames);
+
+    ap.arg("--inputfilename %s:OUTFILENAME")
+        .help("Input filename of braw file, may be repeated or given as trailing filenames")
+        .action(set_inputfilename);
+
+    ap.arg("--watch %s:DIRECTORY")
+        .help("Watch directory for new braw clips and process them as they are fully written, may be repeated")
+        .action(set_watch);
+
+    ap.arg("--watchinterval %s:SECONDS")
+        .help("Seconds a clip and its proxy files must be unchanged before processing (5)")
+        .action(set_watchinterval);
 
-    ap.arg("--inputfilename %s:OUTFILENAME").help("Input filename of braw file").action(set_inputfilename);
+    ap.arg("--watchjournal %s:JOURNAL")
+        .help("Journal of completed clips in watch mode (<outputdirectory>/.brawtool_watch)")
+        .action(set_watchjournal);
 
     ap.arg("--kelvin %s:KELVIN").help("Input white balance kelvin adjustment").action(set_kelvin);
 
@@ -594,6 +4577,36 @@ main(int argc, const char* argv[])
 
     ap.arg("--exposure %s:EXPOSURE").help("Input linear exposure adjustment").action(set_exposure);
 
+    ap.arg("--benchmark", &tool.benchmark).help("Run processing benchmarks on a synthetic 8K frame and exit");
+
+    ap.arg("--synthetic %s:SIZE")
+        .help("Generate synthetic WIDTHxHEIGHT frames instead of decoding braw, no sdk needed")
+        .action(set_synthetic);
+
+    ap.arg("--syntheticframes %s:FRAMES").help("Frames in each synthetic clip (24)").action(set_syntheticframes);
+
+    ap.arg("--metricsfile %s:METRICSFILE")
+        .help("Prometheus text file for metrics, updated periodically and resumed between runs")
+        .action(set_metricsfile);
+
+    ap.arg("--metricsinterval %s:SECONDS")
+        .help("Metrics file update interval in seconds (10)")
+        .action(set_metricsinterval);
+
+    ap.arg("--cachedirectory %s:DIRECTORY")
+        .help("Cache decoded frames as half float exr, reused when clip and decode attributes are unchanged")
+        .action(set_cachedirectory);
+
+    ap.arg("--cachesize %s:MEGABYTES")
+        .help("Frame cache size, least recently used frames are evicted (10240)")
+        .action(set_cachesize);
+
+    ap.arg("--bufferpool %s:MEGABYTES")
+        .help("Idle frame buffers kept for reuse between frames and clips (4096)")
+        .action(set_bufferpool);
+
+    ap.arg("--hugepages", &tool.hugepages).help("Align frame buffers to huge pages, backed by huge pages on Linux");
+
     ap.separator("Output flags:");
     ap.arg("--outputdirectory %s:OUTFILENAME").help("Output directory of braw files").action(set_outputdirectory);
 
@@ -603,16 +4616,90 @@ main(int argc, const char* argv[])
 
     ap.arg("--cloneproxy", &tool.cloneproxy).help("Clone proxy directory to output directory");
 
+    ap.arg("--hashcache %s:HASHCACHE")
+        .help("Hash cache file used when extended attributes are not supported (~/.brawtool_hashcache)")
+        .action(set_hashcache);
+
+    ap.arg("--trim %s:FRAMES")
+        .help("Trim braw frame range START-END to output directory instead of a full clone")
+        .action(set_trim);
+
+    ap.arg("--thumbnail", &tool.thumbnail)
+        .help("Write eighth resolution thumbnails for all clips before full resolution work");
+
+    ap.arg("--proxypreview", &tool.proxypreview)
+        .help("Read preview images from the proxy mp4 when requested sizes fit, braw decode otherwise");
+
+    ap.arg("--extractaudio", &tool.extractaudio).help("Extract clip audio to broadcast wave file in output directory");
+
+    ap.arg("--stream %s:STREAM")
+        .help("Stream decoded, resized and 3dlut applied frames to a file or named pipe, - for stdout")
+        .action(set_stream);
+
+    ap.arg("--streamformat %s:FORMAT").help("Stream format (y4m, rgb24, rgb48)").action(set_streamformat);
+
+    ap.arg("--streambuffer %s:FRAMES")
+        .help("Frames decoded ahead of the stream in the reorder buffer (4)")
+        .action(set_streambuffer);
+
+    ap.arg("--frames %s:FRAMES").help("Frame range START-END to stream (all)").action(set_frames);
+
     ap.arg("--apply3dlut", &tool.apply3dlut).help("Apply 3dlut to preview image");
 
     ap.arg("--applymetadata", &tool.applymetadata).help("Apply metadata to preview image");
 
+    ap.arg("--stats", &tool.stats).help("Write histogram, min/max/mean, clipping and waveform statistics as json");
+
     ap.arg("--override3dlut %s:OVERRIDE3DLUT").help("Override 3dlut for preview image").action(set_override3dlut);
 
+    ap.arg("--lutengine %s:ENGINE")
+        .help("3dlut engine, builtin kernels when equal to ocio or ocio only (auto, ocio)")
+        .action(set_lutengine);
+
+    ap.arg("--variant %s:VARIANT")
+        .help("Output variant of the decoded frame (name:width=,height=,lut=,metadata=,format=,datatype=)")
+        .action(set_variant);
+
+    ap.arg("--wedge %s:WEDGE")
+        .help("Wedge decode attributes from one frame read, repeated flags are combined (kelvin=,tint=,exposure=)")
+        .action(set_wedge);
+
+    ap.arg("--wedgegrid", &tool.wedgegrid).help("Assemble wedges into a labelled grid instead of separate files");
+
+    ap.arg("--pyramid %s:LEVELS")
+        .help("Output successively halved pyramid levels of each preview image (<name>_p<level>)")
+        .action(set_pyramid);
+
+    ap.arg("--pyramidfilter %s:FILTER").help("Pyramid downsample filter (box, lanczos3)").action(set_pyramidfilter);
+
+    ap.arg("--resizefilter %s:FILTER")
+        .help("Resize filter for preview images (triangle, box, gaussian, lanczos3, fast)")
+        .action(set_resizefilter);
+
+    ap.arg("--outputdatatype %s:OUTDATATYPE")
+        .help("Output datatype for preview image (uint8, uint10, uint12, uint16, half, float)")
+        .action(set_outputdatatype);
+
+    ap.arg("--compression %s:COMPRESSION")
+        .help("Output compression for preview image (e.g. zip, dwaa:45, piz)")
+        .action(set_compression);
+
+    ap.arg("--tilesize %s:TILESIZE")
+        .help("Output tile size for formats with tile support (exr, tif)")
+        .action(set_tilesize);
+
+    ap.arg("--threads %s:THREADS")
+        .help("Number of threads used for processing and encoding (0 = all)")
+        .action(set_threads);
+
     ap.arg("--width %s:WIDTH").help("Output width of preview image").action(set_width);
 
     ap.arg("--height %s:HEIGHT").help("Output height of preview image").action(set_height);
 
+    ap.arg("--crop %s:CROP")
+        .help("Crop region X,Y,WIDTH,HEIGHT of the decoded frame, applied before all processing")
+        .action(set_crop);
+
     // clang-format on
     if (ap.parse_args(argc, (const char**)argv) < 0) {
         print_error("Could no parse arguments: ", ap.geterror());
@@ -625,7 +4712,15 @@ main(int argc, const char* argv[])
         ap.abort();
         return EXIT_SUCCESS;
     }
-    if (tool.inputfilename.length() == 0) {
+    bufferpool.set_limit(static_cast<size_t>(tool.bufferpool) * 1024 * 1024);
+    bufferpool.set_hugepages(tool.hugepages);
+    if (tool.benchmark) {
+        return run_benchmark();
+    }
+    if (tool.syntheticwidth > 0 && !tool.inputfilenames.size() && !tool.watchdirectories.size()) {
+        tool.inputfilenames.push_back("synthetic.braw");  // names the output files only
+    }
+    if (!tool.inputfilenames.size() && !tool.watchdirectories.size()) {
         print_error("missing parameter: ", "inputfilename");
         ap.briefusage();
         ap.abort();
@@ -643,468 +4738,227 @@ main(int argc, const char* argv[])
         return EXIT_FAILURE;
     }
 
-    // braw program
-    print_info("brawtool -- a set of utilities for processing braw encoded images");
-
-    // read colorspaces
-    print_info("reading braw colorspaces");
-    std::map<std::string, BrawColorspace> colorspaces;
-    {
-        std::string jsonfile = resources_path("brawtool.json");
-        std::ifstream json(jsonfile);
-        if (json.is_open()) {
-            ptree pt;
-            read_json(jsonfile, pt);
-            for (const std::pair<const ptree::key_type, ptree>& item : pt) {
-                std::string name = item.first;
-                const ptree data = item.second;
-
-                BrawColorspace colorspace {
-                    resources_path(data.get<std::string>("description", "")),
-                    resources_path(data.get<std::string>("filename", "")),
-                };
-
-                if (!Filesystem::exists(colorspace.filename)) {
-                    print_warning("'filename' does not exist for colorspace: ", colorspace.filename);
-                    continue;
-                }
-
-                colorspaces[name] = colorspace;
-            }
-        }
-        else {
-            print_warning("could not open colorspaces file: ", jsonfile);
+    if (tool.outputdatatype.size()) {
+        BrawDatatype type;
+        if (!datatype_by_str(tool.outputdatatype, type)) {
+            print_error("unknown output datatype: ", tool.outputdatatype);
             ap.abort();
             return EXIT_FAILURE;
         }
-
-        if (tool.override3dlut.size()) {
-            if (!colorspaces.count(tool.override3dlut)) {
-                print_error("unknown override 3dlut: ", tool.override3dlut);
-                ap.abort();
-                return EXIT_FAILURE;
-            }
+        if ((type.bitspersample == 10 || type.bitspersample == 12) && !packed_datatype(tool.outputformat)) {
+            print_warning("10 and 12-bit output is only supported for dpx and tiff, written as uint16: ",
+                          tool.outputdatatype);
         }
     }
 
-    // read braw data
-    print_info("reading braw data from file: ", tool.inputfilename);
-    ImageBuf imageBuf;
-    {
-        HRESULT result = S_OK;
-        IBlackmagicRawFactory* factory = nullptr;
-        factory = CreateBlackmagicRawFactoryInstanceFromPath(CFSTR(BlackmagicRaw_LIBRARY_PATH));
-        if (factory == nullptr) {
-            print_error("could not initialize blackmagic factory from path: ", BlackmagicRaw_LIBRARY_PATH);
-            return EXIT_FAILURE;
-        }
-
-        IBlackmagicRaw* codec = nullptr;
-        result = factory->CreateCodec(&codec);
-        if (result != S_OK) {
-            print_error("could not create codec from blackmagic api");
-            return EXIT_FAILURE;
-        }
-
-        IBlackmagicRawClip* clip = nullptr;
-        CFStringRef clipfilename = cfstr_by_str(tool.inputfilename);
-        result = codec->OpenClip(clipfilename, &clip);
-        if (result != S_OK) {
-            print_error("could not open input filename: ", tool.inputfilename);
-            return EXIT_FAILURE;
-        }
+    if (tool.lutengine != "auto" && tool.lutengine != "ocio") {
+        print_error("unknown 3dlut engine: ", tool.lutengine);
+        ap.abort();
+        return EXIT_FAILURE;
+    }
+    if (tool.pyramidfilter != "box" && tool.pyramidfilter != "lanczos3") {
+        print_error("unknown pyramid filter: ", tool.pyramidfilter);
+        ap.abort();
+        return EXIT_FAILURE;
+    }
 
-        BrawCallback* callback = new BrawCallback();
-        callback->AddRef();
-        if (tool.kelvin.has_value()) {
-            callback->SetKelvin(tool.kelvin.value());
-        }
-        if (tool.tint.has_value()) {
-            callback->SetTint(tool.tint.value());
-        }
-        if (tool.exposure.has_value()) {
-            callback->SetExposure(tool.exposure.value());
-        }
+    if (tool.resizefilter != "triangle" && tool.resizefilter != "box" && tool.resizefilter != "gaussian"
+        && tool.resizefilter != "lanczos3" && tool.resizefilter != "fast") {
+        print_error("unknown resize filter: ", tool.resizefilter);
+        ap.abort();
+        return EXIT_FAILURE;
+    }
 
-        result = codec->SetCallback(callback);
-        if (result != S_OK) {
-            print_error("could not set callback for input filename: ", tool.inputfilename);
-            return EXIT_FAILURE;
-        }
+    if (tool.streamformat != "y4m" && tool.streamformat != "rgb24" && tool.streamformat != "rgb48") {
+        print_error("unknown stream format: ", tool.streamformat);
+        ap.abort();
+        return EXIT_FAILURE;
+    }
 
-        IBlackmagicRawMetadataIterator* clipMetadataIterator = nullptr;
-        result = clip->GetMetadataIterator(&clipMetadataIterator);
-        if (result != S_OK) {
-            print_error("could not set get clip meta data for input filename: ", tool.inputfilename);
+    // frame source
+    if (tool.syntheticwidth > 0) {
+        if (tool.syntheticframes <= 0) {
+            print_error("synthetic frames must be positive: ", str_by_int(tool.syntheticframes));
+            ap.abort();
             return EXIT_FAILURE;
         }
-
-        IBlackmagicRawJob* job = nullptr;
-        long time = 0;
-        result = clip->CreateJobReadFrame(time, &job);
-        if (result != S_OK) {
-            print_error("could not read frame for input filename: ", tool.inputfilename);
+        if (tool.trimstart >= 0 || tool.wedges.size() || tool.extractaudio) {
+            print_error("trim, wedges and audio need a braw clip, not supported with: ", "--synthetic");
+            ap.abort();
             return EXIT_FAILURE;
         }
+    }
+#if !defined(BlackmagicRaw_FOUND)
+    else {
+        print_error("built without the blackmagic raw sdk, use: ", "--synthetic");
+        ap.abort();
+        return EXIT_FAILURE;
+    }
+#endif
 
-        result = job->Submit();
-        if (result != S_OK) {
-            job->Release();
-            print_error("could not submit job for input filename: ", tool.inputfilename);
-            return EXIT_FAILURE;
+    // stream
+    if (tool.stream.size()) {
+        if (tool.stream == "-") {
+            std::cout.rdbuf(std::cerr.rdbuf());  // stdout carries frames, messages are moved to stderr
+            Sysutil::setup_crash_stacktrace("stderr");
         }
-        codec->FlushJobs();
+        signal(SIGPIPE, SIG_IGN);  // a closed reader fails the write instead of terminating
+    }
 
-        IBlackmagicRawFrame* frame = callback->GetFrame();
-        if (frame == nullptr) {
-            print_error("could not get frame for input filename: ", tool.inputfilename);
-            return EXIT_FAILURE;
-        }
+    // braw program
+    print_info("brawtool -- a set of utilities for processing braw encoded images");
 
-        IBlackmagicRawMetadataIterator* frameMetadataIterator = nullptr;
-        result = frame->GetMetadataIterator(&frameMetadataIterator);
-        if (result != S_OK) {
-            print_error("could not get frame meta data for input filename: ", tool.inputfilename);
-            return EXIT_FAILURE;
-        }
+    // metrics
+    struct MetricsGuard {
+        ~MetricsGuard() { metrics.stop(); }  // final write on every return path
+    } metricsguard;
+    if (tool.metricsfile.size()) {
+        print_info("writing metrics to file: ", tool.metricsfile);
+        metrics.start(tool.metricsfile, tool.metricsinterval);
+    }
 
-        // metadata
-        callback->ProcessMetaData(clipMetadataIterator);
-        callback->ProcessMetaData(frameMetadataIterator);
+    // threads
+    if (tool.threads > 0) {
+        OIIO::attribute("threads", tool.threads);
+    }
+    OIIO::attribute("exr_threads", tool.threads);  // 0 uses all hardware threads for threaded exr compression
 
-        imageBuf = callback->GetImageBuf();  // this is a deep copy
-        if (imageBuf.has_error()) {
-            print_error("could not read image buffer from filename: ", tool.inputfilename);
-        }
-        if (callback->GetFrame() != nullptr) {
-            callback->SetFrame(nullptr);  // needed to force codec to release callback, reported to bm support
-        }
-        if (callback != nullptr) {
-            callback->Release();
-        }
-        if (clipMetadataIterator != nullptr) {
-            clipMetadataIterator->Release();
-        }
-        if (frameMetadataIterator != nullptr) {
-            frameMetadataIterator->Release();
-        }
-        if (clip != nullptr) {
-            clip->Release();
-        }
-        if (codec != nullptr) {
-            codec->Release();
-        }
-        if (factory != nullptr) {
-            factory->Release();
+    // read colorspaces
+    print_info("reading braw colorspaces");
+    std::map<std::string, BrawColorspace> colorspaces;
+    {
+        std::string jsonfile = resources_path("brawtool.json");
+        if (!read_colorspaces(jsonfile, colorspaces)) {
+            print_warning("could not open colorspaces file: ", jsonfile);
+            ap.abort();
+            metrics.failure("colorspaces");
+            return EXIT_FAILURE;
         }
-        CFRelease(clipfilename);
-
-        if (tool.width.has_value() > 0 || tool.height.has_value() > 0) {
-            ImageSpec spec = imageBuf.spec();
-            int width = tool.width.value();
-            int height = tool.height.value();
-
-            float aspectratio = static_cast<float>(spec.width) / spec.height;
-            float resizeaspectratio = static_cast<float>(width) / height;
-
-            int resizewidth, resizeheight;
-            if (aspectratio > resizeaspectratio) {
-                resizewidth = width;
-                resizeheight = static_cast<int>(width / aspectratio);
-            }
-            else {
-                resizewidth = static_cast<int>(height * aspectratio);
-                resizeheight = height;
-            }
-            ImageBuf resizedbuf;
-            ImageBufAlgo::resize(resizedbuf, imageBuf, "triangle", 0, ROI(0, resizewidth, 0, resizeheight));
-
-            ImageSpec copyspec(width, height, spec.nchannels, spec.format);
-            ImageBuf copybuf(copyspec);
-            ImageBufAlgo::zero(copybuf);
 
-            int xoffset = (width - resizewidth) / 2;
-            int yoffset = (height - resizeheight) / 2;
-
-            ImageBufAlgo::paste(copybuf, xoffset, yoffset, 0, 0, resizedbuf);
-            for (const ParamValue& param : spec.extra_attribs) {
-                copybuf.specmod().attribute(param.name().c_str(), param.type(), param.data());
+        if (tool.override3dlut.size()) {
+            if (!colorspaces.count(tool.override3dlut)) {
+                print_error("unknown override 3dlut: ", tool.override3dlut);
+                ap.abort();
+                metrics.failure("colorspaces");
+                return EXIT_FAILURE;
             }
-            imageBuf.copy(copybuf);
         }
     }
 
-    // apply 3dlut
-    if (tool.apply3dlut) {
-        std::string sidecarfile = combine_path(filename_path(tool.inputfilename) + "/Proxy",
-                                               filename(extension(tool.inputfilename, "sidecar")));
-
-        print_info("reading braw sidecardata from file: ", sidecarfile);
-
-        std::ifstream sidecar(sidecarfile);
-        std::string lutfile;
-        std::string lutdirectory;
-        if (sidecar.is_open()) {
-            std::string line;
-            std::string name, title, data;
-            int lutSize = 0;
-            boost::regex multispaces("\\s{2,}");
-            boost::regex leadingspaces("^\\s+");
-            bool datarun = false;
-            while (getline(sidecar, line)) {
-                if (datarun) {
-                    if (line.find("\"") != std::string::npos) {
-                        std::string value = line.substr(0, line.rfind("\""));
-                        value = boost::regex_replace(value, multispaces, " ");
-                        value = boost::regex_replace(value, leadingspaces, "");
-                        data += value;
-                        break;
-                    }
-                    std::string value = boost::regex_replace(line, multispaces, " ");
-                    value = boost::regex_replace(value, leadingspaces, "");
-                    data += value + "\n";
-                    continue;
-                }
-                if (line.find("\"post_3dlut_sidecar_name\":") != std::string::npos) {
-                    boost::regex expr(R"("post_3dlut_sidecar_name"\s*:\s*"([^"]*)\")");
-                    boost::smatch what;
-                    if (boost::regex_search(line, what, expr)) {
-                        name = what[1];
-                    }
-                }
-                else if (line.find("\"post_3dlut_sidecar_title\":") != std::string::npos) {
-                    boost::regex expr(R"("post_3dlut_sidecar_title"\s*:\s*"([^"]*)\")");
-                    boost::smatch what;
-                    if (boost::regex_search(line, what, expr)) {
-                        title = what[1];
-                    }
-                }
-                else if (line.find("\"post_3dlut_sidecar_size\":") != std::string::npos) {
-                    boost::regex expr(R"("post_3dlut_sidecar_size"\s*:\s*(\d+))");
-                    boost::smatch what;
-                    if (boost::regex_search(line, what, expr)) {
-                        lutSize = std::stoi(what[1]);
-                    }
-                }
-                else if (line.find("\"post_3dlut_sidecar_data\":") != std::string::npos) {
-                    datarun = true;
-                    size_t startPos = line.find("\"", line.find(":")) + 1;
-                    if (startPos != std::string::npos && startPos < line.size()) {
-                        std::string value = line.substr(startPos);
-                        if (!value.empty() && value.find("\"") != std::string::npos) {
-                            value = value.substr(0, value.find("\""));
-                        }
-                        value = boost::regex_replace(value, multispaces, " ");
-                        value = boost::regex_replace(value, leadingspaces, "");
-                        data += value + (value.empty() ? "" : "\n");
-                    }
-                }
+    // variants
+    std::vector<BrawVariant> variants = tool.variants;
+    {
+        if (!variants.size()) {
+            BrawVariant variant;
+            variant.width = tool.width;
+            variant.height = tool.height;
+            if (tool.apply3dlut) {
+                variant.lut = tool.override3dlut.size() ? tool.override3dlut : "sidecar";
             }
-            lutdirectory = combine_path(tool.outputdirectory, "/3DLut");
-
-            if (!exists(lutdirectory)) {
-                if (!create_path(lutdirectory)) {
-                    print_error("could not create 3dlut directory: ", lutdirectory);
-                    return EXIT_FAILURE;
-                }
+            variant.applymetadata = tool.applymetadata;
+            variants.push_back(variant);
+        }
+        for (BrawVariant& variant : variants) {
+            if (!variant.outputformat.size()) {
+                variant.outputformat = tool.outputformat;
             }
-
-            lutfile = combine_path(lutdirectory, name);
-
-            if (!exists(lutfile)) {
-                std::ofstream outputFile(lutfile);
-                if (outputFile) {
-                    outputFile << "BMD_TITLE " << title << std::endl;
-                    outputFile << std::endl;
-                    outputFile << "LUT_3D_SIZE " << std::to_string(lutSize) << std::endl;
-                    outputFile << data;
-                    outputFile.close();
-                }
-                else {
-                    print_error("could not open output lut file: ", lutfile);
-                    return EXIT_FAILURE;
-                }
+            if (!variant.outputdatatype.size()) {
+                variant.outputdatatype = tool.outputdatatype;
             }
-
-            print_info("applying 3dlut from file from sidecar");
-            {
-                ConstConfigRcPtr config = Config::CreateRaw();
-                ConstCPUProcessorRcPtr colorspaceProcessor;
-
-                FileTransformRcPtr transform = FileTransform::Create();
-                transform->setSrc(lutfile.c_str());
-                transform->setInterpolation(INTERP_BEST);
-
-                ConstProcessorRcPtr processor = config->getProcessor(transform);
-                colorspaceProcessor = processor->getDefaultCPUProcessor();
-                {
-                    const ImageSpec& spec = imageBuf.spec();
-                    int xres = spec.width;
-                    int yres = spec.height;
-                    int channels = spec.nchannels;
-                    ROI roi = ROI(0, xres, 0, yres, 0, 1, 0, channels);
-                    std::vector<float> pixels(roi.width() * roi.height() * roi.nchannels());
-
-                    if (!imageBuf.get_pixels(roi, TypeDesc::FLOAT, &pixels[0])) {
-                        print_error("failed to get pixel data from the image buffer");
-                        return EXIT_FAILURE;
-                    }
-                    PackedImageDesc imgDesc(&pixels[0], roi.width(), roi.height(), roi.nchannels());
-
-                    // apply color transformation
-                    colorspaceProcessor->apply(imgDesc);
-                    imageBuf.set_pixels(roi, TypeDesc::FLOAT, &pixels[0]);
-                }
+            BrawDatatype type;
+            if (variant.outputdatatype.size() && !datatype_by_str(variant.outputdatatype, type)) {
+                print_error("unknown output datatype for variant: ", variant.name);
+                ap.abort();
+                metrics.failure("arguments");
+                return EXIT_FAILURE;
+            }
+            if (variant.outputdatatype.size() && (type.bitspersample == 10 || type.bitspersample == 12)
+                && !packed_datatype(variant.outputformat)
+                && (variant.outputformat != tool.outputformat || variant.outputdatatype != tool.outputdatatype)) {
+                print_warning("10 and 12-bit output is only supported for dpx and tiff, written as uint16: ",
+                              variant.name);
+            }
+            if (variant.lut.size() && variant.lut != "sidecar" && !colorspaces.count(variant.lut)) {
+                print_error("unknown 3dlut for variant: ", variant.name);
+                ap.abort();
+                metrics.failure("arguments");
+                return EXIT_FAILURE;
             }
-        }
-        else {
-            print_warning("could not find sidecar file: ", sidecarfile);
-            return EXIT_FAILURE;
         }
     }
 
-    // apply metadata
-    if (tool.applymetadata) {
-        print_info("applying metadata from attributes");
-        {
-            std::vector<BrawMetadata> metadatas = {
-                BrawMetadata() = { "filename", "filename", TypeDesc::STRING, 0, 0 },
-                BrawMetadata() = { "exposure", "exposure", TypeDesc::STRING, 0, 0 },
-                BrawMetadata() = { "sensor_rate", "fps", TypeDesc::STRING, 0, 0 },
-                BrawMetadata() = { "shutter_value", "shutter", TypeDesc::STRING, 0, 0 },
-                BrawMetadata() = { "aperture", "iris", TypeDesc::STRING, 0, 0 },
-                BrawMetadata() = { "iso", "iso", TypeDesc::INT, 0, 0 },
-                BrawMetadata() = { "white_balance_kelvin", "wb", TypeDesc::INT, 0, 0 },
-                BrawMetadata() = { "white_balance_tint", "tint", TypeDesc::INT, 0, 0 },
-                BrawMetadata() = { "lens_type", "lens", TypeDesc::STRING, 0, 0 },
-                BrawMetadata() = { "focal_length", "focal length", TypeDesc::STRING, 0, 0 },
-                BrawMetadata() = { "distance", "focus", TypeDesc::STRING, 0, 0 },
-                BrawMetadata() = { "date_recorded", "date", TypeDesc::STRING, 0, 0 },
-            };
-            int width = imageBuf.spec().width;
-            int height = imageBuf.spec().height;
-            int x = width * 0.02;
-            int y = height * 0.04f;
-            for (BrawMetadata metadata : metadatas) {
-                const ImageSpec& spec = imageBuf.spec();
-                int width = imageBuf.spec().width;
-                int height = imageBuf.spec().height;
-                if (metadata.key == "filename") {
-                    metadata.name = filename(tool.inputfilename);
-                }
-                else {
-                    const ParamValue* attr = spec.find_attribute(metadata.key);
-                    if (attr) {
-                        std::string value;
-                        const TypeDesc type = attr->type();
-                        switch (type.basetype) {
-                        case TypeDesc::STRING: value = *(const char**)attr->data(); break;
-                        case TypeDesc::FLOAT: value = str_by_float(*(const float*)attr->data()); break;
-                        case TypeDesc::INT8: value = std::to_string(*(const char*)attr->data()); break;
-                        case TypeDesc::UINT8: value = std::to_string(*(const unsigned char*)attr->data()); break;
-                        case TypeDesc::INT16: value = std::to_string(*(const short*)attr->data()); break;
-                        case TypeDesc::UINT16: value = std::to_string(*(const unsigned short*)attr->data()); break;
-                        case TypeDesc::INT: value = std::to_string(*(const int*)attr->data()); break;
-                        case TypeDesc::UINT: value = std::to_string(*(const unsigned int*)attr->data()); break;
-                        }
-                        if (metadata.key == "exposure") {
-                            if (tool.exposure.has_value()) {
-                                metadata.name = metadata.name + ": " + str_by_float(tool.exposure.value()) + " ("
-                                                + value + ")";
-                            }
-                            else {
-                                metadata.name = metadata.name + ": " + value;
-                            }
-                        }
-                        else if (metadata.key == "white_balance_kelvin") {
-                            if (tool.kelvin.has_value()) {
-                                metadata.name = metadata.name + ": " + std::to_string(tool.kelvin.value()) + " ("
-                                                + value + ")";
-                            }
-                            else {
-                                metadata.name = metadata.name + ": " + value;
-                            }
-                        }
-                        else if (metadata.key == "white_balance_tint") {
-                            if (tool.tint.has_value()) {
-                                metadata.name = metadata.name + ": " + std::to_string(tool.tint.value()) + " (" + value
-                                                + ")";
-                            }
-                            else {
-                                metadata.name = metadata.name + ": " + value;
-                            }
-                        }
-                        else {
-                            metadata.name = metadata.name + ": " + value;
-                        }
-                    }
-                }
-                metadata.x = x;
-                metadata.y = y;
-                y += draw_metadata(imageBuf, metadata).height() + height * 0.01f;
-            }
+    // wedges
+    BrawVariant wedgevariant;
+    if (tool.wedges.size()) {
+        wedgevariant.name = "wedge";
+        wedgevariant.width = tool.width;
+        wedgevariant.height = tool.height;
+        if (tool.apply3dlut) {
+            wedgevariant.lut = tool.override3dlut.size() ? tool.override3dlut : "sidecar";
         }
+        wedgevariant.applymetadata = tool.applymetadata && !tool.wedgegrid;
+        wedgevariant.outputformat = tool.outputformat;
+        wedgevariant.outputdatatype = tool.outputdatatype;
+        print_info("decoding wedges from one frame read: ", str_by_int(static_cast<int>(tool.wedges.size())));
     }
 
-    // clone braw
-    if (tool.clonebraw) {
-        std::string clonefilename = combine_path(tool.outputdirectory, filename(tool.inputfilename));
-        copy_file(tool.inputfilename, clonefilename);
-        if (!file_compare(tool.inputfilename, clonefilename)) {
-            print_error("failed when trying to clone input file to: ", clonefilename);
-            return EXIT_FAILURE;
+    // stream
+    BrawVariant streamvariant;
+    if (tool.stream.size()) {
+        streamvariant.name = "stream";
+        streamvariant.width = tool.width;
+        streamvariant.height = tool.height;
+        if (tool.apply3dlut) {
+            streamvariant.lut = tool.override3dlut.size() ? tool.override3dlut : "sidecar";
         }
     }
 
-    // clone proxy
-    if (tool.cloneproxy) {
-        std::string proxydirname = combine_path(tool.outputdirectory, "Proxy");
-        if (!exists(proxydirname)) {
-            if (!create_path(proxydirname)) {
-                print_error("could not create proxy directory: ", proxydirname);
-                return EXIT_FAILURE;
-            }
+    // thumbnail
+    BrawVariant thumbnailvariant;
+    if (tool.thumbnail) {
+        thumbnailvariant.name = "thumb";
+        if (tool.apply3dlut) {
+            thumbnailvariant.lut = tool.override3dlut.size() ? tool.override3dlut : "sidecar";
         }
+        thumbnailvariant.applymetadata = tool.applymetadata;
+        thumbnailvariant.outputformat = tool.outputformat;
+        thumbnailvariant.outputdatatype = tool.outputdatatype;
+    }
 
-        // mp4
-        std::string mp4file = combine_path(filename_path(tool.inputfilename) + "/Proxy",
-                                           filename(extension(tool.inputfilename, "mp4")));
-        if (exists(mp4file)) {
-            std::string mp4outputfile = combine_path(proxydirname, filename(mp4file));
-            copy_file(mp4file, mp4outputfile);
-            if (!file_compare(mp4file, mp4outputfile)) {
-                print_error("failed when trying to clone mp4 file to: ", mp4outputfile);
-                return EXIT_FAILURE;
-            }
-        }
-        else {
-            print_warning("could not find proxy mp4 file: ", mp4file);
-        }
+    // output directory, created once before clips are scheduled on both lanes
+    if (!exists(tool.outputdirectory) && !create_path(tool.outputdirectory)) {
+        print_error("could not create output directory: ", tool.outputdirectory);
+        return EXIT_FAILURE;
+    }
 
-        // sidecar
-        std::string sidecarfile = combine_path(filename_path(tool.inputfilename) + "/Proxy",
-                                               filename(extension(tool.inputfilename, "sidecar")));
-        if (exists(sidecarfile)) {
-            std::string sidecaroutputfile = combine_path(proxydirname, filename(sidecarfile));
-            copy_file(sidecarfile, sidecaroutputfile);
-            if (!file_compare(sidecarfile, sidecaroutputfile)) {
-                print_error("failed when trying to clone sidecar file to: ", sidecaroutputfile);
-                return EXIT_FAILURE;
-            }
+    // process
+    BrawSession session;
+    session.colorspaces = std::move(colorspaces);
+    session.variants = std::move(variants);
+    session.wedgevariant = wedgevariant;
+    session.streamvariant = streamvariant;
+    session.thumbnailvariant = thumbnailvariant;
+    if (tool.watchdirectories.size()) {
+        return watch_directories(session);
+    }
+
+    // schedule, thumbnails for all clips first, clones overlap with renders on the io lane
+    BrawScheduler scheduler;
+    for (const std::string& inputfilename : tool.inputfilenames) {
+        if (tool.thumbnail) {
+            scheduler.add(BrawScheduler::Cpu, BrawScheduler::Preview,
+                          [&session, inputfilename]() { return preview_clip(session, inputfilename) == EXIT_SUCCESS; });
         }
-        else {
-            print_warning("could not find proxy mp4 file: ", mp4file);
+        scheduler.add(BrawScheduler::Cpu, BrawScheduler::Render,
+                      [&session, inputfilename]() { return render_clip(session, inputfilename) == EXIT_SUCCESS; });
+        if (tool.clonebraw || tool.cloneproxy) {
+            scheduler.add(BrawScheduler::Io, BrawScheduler::Clone,
+                          [inputfilename]() { return clone_clip(inputfilename) == EXIT_SUCCESS; });
         }
     }
-
-    std::string outputfilename = combine_path(tool.outputdirectory,
-                                              filename(extension(tool.inputfilename, "." + tool.outputformat)));
-
-    print_info("writing output file: ", outputfilename);
-
-    if (!imageBuf.write(outputfilename)) {
-        print_error("could not write file: ", imageBuf.geterror());
-        return EXIT_FAILURE;
+    bool succeeded = scheduler.run();
+    if (tool.verbose) {
+        print_info("buffer pool: ", bufferpool.str());
     }
-    return EXIT_SUCCESS;
+    return succeeded ? EXIT_SUCCESS : EXIT_FAILURE;
 }
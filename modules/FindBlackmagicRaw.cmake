@@ -35,7 +35,7 @@ find_package_handle_standard_args (
 if (BlackmagicRaw_FOUND)
   message (STATUS "Found BlackmagicRaw: include at ${BlackmagicRaw_INCLUDE_DIRS}, library at ${BlackmagicRaw_LIBRARY_PATH}, sources ${BlackmagicRaw_SOURCES}, library at ${BlackmagicRaw_LIBRARIES}")
 else ()
-  message (FATAL_ERROR "Could not find BlackmagicRaw")
+  message (STATUS "Could not find BlackmagicRaw")
 endif ()
 
 mark_as_advanced (BlackmagicRaw_INCLUDE_DIRS BlackmagicRaw_SOURCES BlackmagicRaw_LIBRARIES)